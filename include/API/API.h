@@ -6,20 +6,29 @@ class API {
   public:
     static void createTable(const std::string &tableName,
                             const std::string &primaryKey,
-                            const std::vector<Attribute> &attributes);
+                            const std::vector<Attribute> &attributes,
+                            const TableEngine engine = TableEngine::HEAP);
 
     static void dropTable(const std::string &tableName);
 
+    // A B+tree index built on a populated table fills each node to
+    // fillFactor percent, or to the default of the tree if it is 0.
     static void createIndex(const std::string &indexName,
                             const std::string &tableName,
-                            const std::string &attrName);
+                            const std::vector<std::string> &attrNames,
+                            const IndexType type = IndexType::BTREE,
+                            const std::vector<std::string> &includeNames = {},
+                            const int fillFactor = 0);
 
     static void dropIndex(const std::string &indexName);
 
+    // Bytes of memory an index takes, which only those of type art do.
+    static size_t indexFootprint(const std::string &indexName);
+
     static std::pair<std::shared_ptr<Schema>, std::vector<Record>>
     select(const std::vector<std::string> &attributes,
            const std::string &tableName,
-           const std::vector<Predicate> &predicates);
+           const std::vector<Predicate> &predicates, int limit, int offset);
 
     static void insert(const std::string &tableName,
                        const std::vector<Value> &values);
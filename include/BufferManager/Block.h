@@ -1,4 +1,5 @@
 #pragma once
+#include <atomic>
 #include <cstdint>
 #include <memory>
 #include <string>
@@ -21,28 +22,83 @@ inline uint32_t inBlockOffset(const uint32_t byteOffset) {
     return byteOffset - blockOffset(byteOffset) * BLOCK_SIZE;
 }
 
+// Reader-writer latch for data shared between threads, such as a cached
+// page. It spins rather than sleeps, as it is only held across short
+// in-memory work. Readers wait while a writer does, so that a steady
+// stream of them cannot starve it; a thread must therefore not take a
+// latch it already holds shared.
+//
+// The latch also counts versions of the data, odd while it is held
+// exclusively, so that a reader may instead read without latching and
+// then validate that no writer got in meanwhile. Data read that way may
+// be torn and has to be used with care until it is validated.
+class Latch {
+  private:
+    std::atomic<int> state;   // -1 while held exclusively, else the readers
+    std::atomic<int> waiting; // writers waiting for the latch
+    std::atomic<uint64_t> version;
+    Latch(const Latch &) = delete;
+    Latch &operator=(const Latch &) = delete;
+    void acquire();
+
+  public:
+    Latch() : state(0), waiting(0), version(0) {}
+    void lockShared();
+    void unlockShared();
+    void lock();
+    void unlock();
+    // Waits for no writer to hold the latch and returns the version of the
+    // data, to read it optimistically.
+    uint64_t stableVersion() const;
+    // Whether the data is still at a version.
+    bool validate(uint64_t) const;
+    // Latch, shared or exclusively, data read optimistically at a version,
+    // unless it has changed since. Return false if it did.
+    bool lockSharedAt(uint64_t);
+    bool lockAt(uint64_t);
+};
+
+// Holds a latch, shared or exclusively, for the lifetime of the guard.
+class LatchGuard {
+  private:
+    Latch &latch;
+    bool exclusive;
+    LatchGuard(const LatchGuard &) = delete;
+    LatchGuard &operator=(const LatchGuard &) = delete;
+
+  public:
+    LatchGuard(Latch &latch, bool exclusive)
+        : latch(latch), exclusive(exclusive) {
+        exclusive ? latch.lock() : latch.lockShared();
+    }
+    ~LatchGuard() { exclusive ? latch.unlock() : latch.unlockShared(); }
+};
+
 class Block {
   private:
     std::string filename;
     uint32_t offset;
-    bool free, dirty, pinned;
+    bool free, dirty;
+    std::atomic<uint32_t> pins;
     Block(const Block &) = delete;
     Block &operator=(const Block &) = delete;
-    uint32_t pos;
 
   public:
     char block_data[BLOCK_SIZE];
+    // guards the page among threads; only taken with the block pinned, as
+    // an evicted page comes back as a new block
+    Latch latch;
     Block(const BlockID &);
     const std::string &getFilename() const { return filename; }
     const uint32_t getOffset() const { return offset; }
     inline bool isFree() const { return free; }
     inline bool isDirty() const { return dirty; }
-    inline bool isPinned() const { return pinned; }
+    inline bool isPinned() const { return pins > 0; }
     inline void setFree(const bool value) { free = value; }
     inline void setDirty(const bool value) { dirty = value; }
-    inline void setPinned(const bool value) { pinned = value; }
-    inline void resetPos(uint32_t newPos = 0u) { pos = newPos; }
-    void read(char *dest, size_t size);
+    // pins nest; the block may be evicted once every pin is released
+    inline void pin() { pins++; }
+    inline void unpin() { pins--; }
     void readFile();
     void writeFile();
     void createFile();
@@ -16,8 +16,13 @@ void createFile(const std::string &, const File::FileType);
 
 void deleteFile(const std::string &);
 
+// The cache may be used from several threads at once. A block returned by
+// readBlock may be evicted as soon as the cache needs room; pinBlock pins it
+// before any other thread can evict it.
 PtrBlock readBlock(const BlockID &);
 
+PtrBlock pinBlock(const BlockID &);
+
 void writeBlock(const BlockID &, const char *src, uint32_t start, size_t size);
 
 } // namespace BM
\ No newline at end of file
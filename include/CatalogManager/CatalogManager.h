@@ -8,6 +8,10 @@ namespace CM {
 
 constexpr size_t NAME_LENGTH = 64;
 
+// Longest encoded key an index may have, so that every B+tree node holds
+// several entries.
+constexpr size_t KEY_LENGTH = BM::BLOCK_SIZE / 4;
+
 extern std::unordered_map<std::string, std::shared_ptr<Schema>> mapSchemas;
 extern std::unordered_map<std::string, Index> mapIndices;
 
@@ -17,11 +21,14 @@ void exit();
 bool hasTable(const std::string &);
 
 void createTable(const std::string &, const std::string &,
-                 const std::vector<Attribute> &);
+                 const std::vector<Attribute> &,
+                 const TableEngine = TableEngine::HEAP);
 
 void dropTable(const std::string &);
 
-void createIndex(const std::string &, const std::string &, const std::string &);
+void createIndex(const std::string &, const std::string &,
+                 const std::vector<std::string> &, const IndexType,
+                 const std::vector<std::string> &);
 
 void dropIndex(const std::string &);
 
@@ -29,6 +36,8 @@ void checkPredicates(const std::string &, const std::vector<Predicate> &);
 
 std::string hasIndex(const std::string &, const std::string &);
 
+std::vector<Index> getIndices(const std::string &);
+
 std::shared_ptr<Schema> getSchema(const std::string &);
 
 } // namespace CM
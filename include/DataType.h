@@ -2,6 +2,7 @@
 #include <Error.h>
 #include <cstring>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -128,18 +129,61 @@ struct Predicate {
     std::string attrName;
     OpType op;
     Value val;
+
+    bool satisfiedBy(const Value &value) const {
+        switch (op) {
+        case OpType::EQ:
+            return value == val;
+        case OpType::NE:
+            return value != val;
+        case OpType::LT:
+            return value < val;
+        case OpType::LEQ:
+            return value <= val;
+        case OpType::GT:
+            return value > val;
+        case OpType::GEQ:
+            return value >= val;
+        }
+        throw std::logic_error("illegal OpType");
+    }
 };
 
+// A table of the lsm engine keeps its records in sorted runs of record
+// ids, written out from memory and merged in the background, rather than
+// in a heap file. One of the memory engine keeps them in memory, and
+// finds them by primary key without an index file.
+enum class TableEngine { HEAP, LSM, MEMORY };
+
 struct Schema {
     std::string tableName;
     std::string primaryKey;
     std::vector<Attribute> attributes;
+    TableEngine engine = TableEngine::HEAP;
 };
 
 using Record = std::vector<Value>;
 
+// A buffered index is a B+tree that collects inserts in memory and adds
+// them in key order, a batch at a time. An art index is an adaptive radix
+// tree kept in memory only, built from the table when the index is
+// created and again at every start. A bitmap index keeps the set of
+// record offsets of each distinct key, for attributes with few values.
+enum class IndexType { BTREE, HASH, BUFFERED, ART, BITMAP };
+
 struct Index {
     std::string indexName;
     std::string tableName;
-    std::string attrName;
+    std::vector<std::string> attrNames; // key attributes in order
+    // attributes stored along with the key in the leaves
+    std::vector<std::string> includeNames;
+    IndexType type = IndexType::BTREE;
+    bool isUnique = false; // follows from the schema, not stored
+
+    // key attributes followed by the included ones
+    std::vector<std::string> columns() const {
+        auto names(attrNames);
+        names.insert(names.end(), includeNames.begin(), includeNames.end());
+        return names;
+    }
 };
\ No newline at end of file
@@ -4,7 +4,18 @@
 
 namespace File {
 
-enum class FileType { CATALOG = 0x7ACA, TABLE = 0xB17A, INDEX = 0xE81D };
+enum class FileType {
+    CATALOG = 0x7ACA,
+    TABLE = 0xB17A,
+    INDEX = 0xE81D,
+    HASH = 0x4A5B,
+    LSM = 0x15A7,
+    RUN = 0x5EB1,
+    MEMORY = 0x3E30,
+    BITMAP = 0xB175,
+    ZONE = 0x20AE,
+    BLOOM = 0xB100
+};
 
 inline std::string catalogFilename() { return "dbms/minisql.ctl"; }
 
@@ -16,6 +27,30 @@ inline std::string indexFilename(const std::string &name) {
     return "dbms/minisql_" + name + ".idx";
 }
 
+inline std::string runFilename(const std::string &name, const int num) {
+    return "dbms/minisql_" + name + ".run" + std::to_string(num);
+}
+
+// An immutable sorted run of a table of the lsm engine.
+inline std::string sortedRunFilename(const std::string &name, const int num) {
+    return "dbms/minisql_" + name + ".sst" + std::to_string(num);
+}
+
+// Bloom filter of the keys of a B+tree index.
+inline std::string bloomFilename(const std::string &name) {
+    return "dbms/minisql_" + name + ".bloom";
+}
+
+// Snapshot of a table of the memory engine.
+inline std::string memoryFilename(const std::string &name) {
+    return "dbms/minisql_" + name + ".mem";
+}
+
+// Summaries of the data blocks of a heap table.
+inline std::string zoneFilename(const std::string &name) {
+    return "dbms/minisql_" + name + ".zone";
+}
+
 inline std::string defaultIndexName(const std::string &tableName,
                                     const std::string &primaryKey) {
     return tableName + primaryKey + "idx";
@@ -24,6 +59,20 @@ inline std::string defaultIndexName(const std::string &tableName,
 #define DELETED_MARK 0x80000000U
 #define DELETED_MASK 0x7FFFFFFFU
 
+// Layout of the data blocks of heap files, in which records no longer
+// straddle blocks. Files from before have 0 in its place and are refused.
+constexpr uint32_t TABLE_VERSION = 1;
+
+// Layout of the nodes of B+tree index files, which are sized by bytes and
+// hold prefix-compressed keys, or packed integers where every key is four
+// or eight bytes wide. Files from before are refused likewise.
+constexpr uint32_t INDEX_VERSION = 2;
+
+// Layout of lsm tables, whose runs are sorted by primary key rather than
+// by record id. Files from before are refused likewise; where they list a
+// run in place of the version, the run is refused for its key width.
+constexpr uint32_t LSM_VERSION = 1;
+
 struct catalogFileHeader {
     uint32_t filetype;
     uint32_t numBlocks;
@@ -37,6 +86,7 @@ struct tableFileHeader {
     uint32_t beginOffset;
     uint32_t availableOffset;
     uint32_t numRecords;
+    uint32_t version; // last, where older headers are followed by zeros
 };
 
 struct indexFileHeader {
@@ -44,6 +94,73 @@ struct indexFileHeader {
     uint32_t numBlocks;
     uint32_t rootOffset;
     uint32_t availableOffset;
+    uint32_t freeOffset; // head of the chain of released nodes
+    uint32_t version;
+};
+
+struct hashFileHeader {
+    uint32_t filetype;
+    uint32_t numBlocks;
+    uint32_t dirOffset;   // first of the consecutive directory blocks
+    uint32_t globalDepth; // the directory has 2^globalDepth entries
+    uint32_t freeOffset;  // head of the chain of released pages
+};
+
+// Block 0 of a table of the lsm engine; the numbers of its runs, oldest
+// first, follow the header.
+struct lsmFileHeader {
+    uint32_t filetype;
+    uint32_t numBlocks;
+    uint32_t entrySize; // bytes of a record image
+    uint32_t nextId;    // id of the next record inserted
+    uint32_t numRecords;
+    uint32_t nextRun; // number of the next run file
+    uint32_t numRuns;
+    uint32_t version;
+};
+
+struct runFileHeader {
+    uint32_t filetype;
+    uint32_t numBlocks;
+    uint32_t numEntries;
+    uint32_t entrySize;
+    uint32_t keyWidth;    // of the primary key in front of each image
+    uint32_t fenceOffset; // first key of each data block, from this block on
+    uint32_t bloomOffset; // bloom filter words, from this block on
+    uint32_t bloomBits;
+};
+
+// Followed by the images of the live records.
+struct memoryFileHeader {
+    uint32_t filetype;
+    uint32_t entrySize;
+    uint32_t numSlots;
+    uint32_t numRecords;
+};
+
+// Followed by each key with its set: the length and bytes of the key, the
+// number of containers, and for each one its upper 16 bits, the number of
+// offsets in it and then those as an array or as a bitmap.
+struct bitmapFileHeader {
+    uint32_t filetype;
+    uint32_t numKeys;
+};
+
+// Followed by the words of the filter.
+struct bloomFileHeader {
+    uint32_t filetype;
+    uint32_t capacity; // keys the filter is sized for
+    uint32_t numKeys;
+    uint32_t numWords;
+};
+
+// Followed by the summary of each data block: the number of records
+// written to it, then the lower and the upper bound of each column.
+struct zoneFileHeader {
+    uint32_t filetype;
+    uint32_t availableOffset; // of the table when the file was written
+    uint32_t numBlocks;
+    uint32_t numColumns;
 };
 
 }; // namespace File
@@ -0,0 +1,72 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace IM {
+
+namespace ART {
+
+// Keys are byte strings in the encoding of IndexManager/Key.h. No key of
+// an index is a prefix of another: CHAR values end with a NUL, the other
+// types have a fixed width, and keys of a non-unique index end with the
+// offset of their record.
+using Key = std::string;
+using Off = uint32_t;
+
+// Bytes of a compressed path stored in a node. A longer path is skipped
+// over on the way down and checked against the key of a leaf.
+constexpr uint32_t MAX_PREFIX = 8;
+
+struct Node;
+struct Leaf;
+
+// Adaptive radix tree, kept in memory only. Each inner node branches on
+// one byte of the key, and is sized to its children: 4 and 16 child nodes
+// keep their bytes sorted in an array, 48 index their children through a
+// byte map, and 256 hold a child for every byte. Bytes that all keys
+// below a node share are stored once in the node instead of in a chain of
+// nodes with one child. Leaves keep the whole key and its offset.
+class Tree {
+  public:
+    Tree() : root(nullptr), numEntries(0), numBytes(0) {}
+    ~Tree() { clear(); }
+    Tree(const Tree &) = delete;
+    Tree &operator=(const Tree &) = delete;
+
+    bool find(const Key &, Off &) const;
+    // Returns false if the key was there already; its offset is replaced.
+    bool insert(const Key &, Off);
+    bool remove(const Key &);
+    void clear();
+
+    // Visits the offsets of the keys between the bounds in key order,
+    // until `visit` returns false. Bounds compare with the keys truncated
+    // to their length, as those of a B+tree cursor do, so that they may
+    // cover the leading attributes only.
+    void scan(const Key *, bool, const Key *, bool,
+              const std::function<bool(Off)> &) const;
+
+    size_t size() const { return numEntries; }
+    // Bytes held by the nodes and leaves.
+    size_t footprint() const { return numBytes; }
+
+  private:
+    Node *root;
+    size_t numEntries;
+    size_t numBytes;
+
+    Leaf *makeLeaf(const Key &, Off);
+    template <typename T> T *makeNode();
+    void release(Node *);
+    void destroy(Node *);
+    bool insert(Node *&, const Key &, Off, size_t);
+    bool remove(Node *&, const Key &, size_t);
+    void addChild(Node *&, unsigned char, Node *);
+    void removeChild(Node *&, unsigned char);
+};
+
+} // namespace ART
+
+} // namespace IM
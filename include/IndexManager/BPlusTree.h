@@ -2,8 +2,14 @@
 #include <BufferManager/Block.h>
 #include <DataType.h>
 #include <FileSpec.h>
+#include <atomic>
 #include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <tuple>
+#include <unordered_map>
 #include <vector>
 
 namespace IM {
@@ -12,38 +18,173 @@ namespace BPlusTree {
 
 using Ptr = uint32_t;
 constexpr Ptr NullPtr = 0U;
-using Key = Value;
+// Keys are byte strings in the encoding of IndexManager/Key.h, so that
+// they compare as std::string does.
+using Key = std::string;
 using Off = uint32_t;
 
+// Nodes hold as many entries as their encoding fits in a block, so the
+// fanout follows from the block size and the width of the keys.
+constexpr size_t NODE_SIZE = BM::BLOCK_SIZE;
+
+// A node encoded in fewer bytes than this is merged with or refilled from
+// a sibling.
+constexpr size_t MIN_NODE_SIZE = NODE_SIZE / 2;
+
+// Longest key stored, as admitted by the catalog (CM::KEY_LENGTH).
+constexpr size_t MAX_KEY_SIZE = NODE_SIZE / 4;
+
+// Share of each node filled by a bulk load; the rest is left for inserts.
+constexpr double FILL_FACTOR = 0.9;
+
+// Internal nodes a tree keeps pinned in the buffer, enough for the top two
+// levels of all but the largest indexes.
+constexpr size_t INNER_CACHE_SIZE = 64;
+
+// Decoded copy of a node, used where a node is modified. Leaves keep one
+// record offset per key in `children`; internal nodes one child more than
+// keys. The nodes of a tree whose keys all have four or eight bytes pack
+// them as integers; those of any other tree cut off the prefix shared by
+// their keys. `width` is that of the packed keys, or 0.
 struct Node {
-    Key *keys;
-    Ptr parent;
-    Ptr *children;
+    std::vector<Key> keys;
+    std::vector<Ptr> children;
+    Ptr sibling;
     bool isLeaf;
-    int numKeys;
-    Node(int);
-    ~Node();
-    bool isRoot();
-    void readFromBlock(BM::PtrBlock, const std::pair<ValueType, size_t> &);
-    void writeToBlock(BM::BlockID);
+    size_t width;
+    explicit Node(size_t width)
+        : sibling(NullPtr), isLeaf(false), width(width) {}
+    size_t size() const;
+    void readFromBlock(const char *);
+    void readFromBlock(BM::PtrBlock blk) { readFromBlock(blk->block_data); }
+    // encodes the node into a page and returns the bytes used
+    size_t encode(char *) const;
+    void writeToBlock(BM::BlockID) const;
+};
+
+struct Tree;
+
+// How a view holds its node: only pinned, read at a version that has to
+// be validated before what was read is trusted, or latched.
+enum class Hold { OPTIMISTIC, SHARED, EXCLUSIVE };
+
+// Hold on a node in place in its buffer page, which stays pinned while
+// viewed. Its contents are read through the key traits of the tree.
+// Reads of a node held optimistically may see it torn; they stay within
+// the page but mean nothing unless the node validates afterwards.
+struct NodeView {
+    const Tree &tree;
+    BM::PtrBlock blk;
+    Ptr offset;
+    Hold hold;
+    uint64_t version; // of a node held optimistically
+    NodeView(const Tree &);
+    NodeView(const Tree &, Ptr);
+    ~NodeView();
+    NodeView(const NodeView &) = delete;
+    NodeView &operator=(const NodeView &) = delete;
+    // holds another node in place of the current one, which is let go of
+    // after the other one is held
+    void load(Ptr, Hold = Hold::OPTIMISTIC);
+    // moves optimistically to a child of the node held optimistically;
+    // false, holding nothing, if the node changed before the child was held
+    bool couple(Ptr);
+    // whether the node held optimistically is still as it was read
+    bool validate() const;
+    // latches the node held optimistically, unless it changed meanwhile
+    bool upgrade(Hold);
+    void release();
+    const char *page() const { return blk->block_data; }
+    bool isLeaf() const;
+    Ptr sibling() const;
 };
 
+// Walks the leaf chain in key order from a lower bound up to an upper
+// bound. A missing bound leaves that end of the range open. Bounds are
+// compared truncating, so they may cover leading attributes only. The
+// cursor holds no latch between calls to next: it resumes after the last
+// key it returned, which a split may have moved to a right sibling, and
+// descends again from the root if a remove may have freed its leaf.
+struct Cursor {
+    const Tree &tree;
+    Key lo, hi, last;
+    bool hasLo, loInclusive, hasHi, hiInclusive, hasLast;
+    Ptr leaf; // NullPtr once the range is exhausted
+    uint64_t epoch;
+    Cursor(const Tree &, const Key *, bool, const Key *, bool);
+    // Appends at most `max` offsets, and their keys if asked for; false
+    // once the range is exhausted.
+    bool next(std::vector<Off> &, size_t max, std::vector<Key> * = nullptr);
+};
+
+// Lookups, scans and inserts may run concurrently on a tree. They descend
+// with optimistic lock coupling: internal nodes are read without latching
+// them and validated against their version before their child is trusted,
+// and the descent starts over from the root whenever a writer got in. A
+// lookup reads its leaf the same way, a scan latches it shared. An insert
+// latches only its leaf exclusively and updates it in place; if the leaf
+// has to split, it latches exclusively, at the versions it read them, the
+// nodes from the lowest ancestor with room for another key down, which are
+// all that the split changes. Removes and bulk loads, which free and
+// rewrite nodes, take the whole tree to themselves.
+//
+// The lookups, scans and inserts are implemented once per kind of keys by
+// the tree that makeTree instantiates, so that node searches compare keys
+// inline; what only rewrites decoded nodes is shared.
 struct Tree {
-    Ptr root;
-    int fanout;
-    std::pair<ValueType, size_t> info;
+    std::atomic<Ptr> root;
     std::string filename;
     File::indexFileHeader header;
-    Tree(int fanout) : fanout(fanout), root(NullPtr) {}
-    std::tuple<Ptr, Off, bool> find(const Key &) const;
+    mutable BM::Latch latch; // exclusive for removes and bulk loads
+    std::atomic<uint64_t> epoch; // counts removes, which may free nodes
+    const size_t keyWidth; // of packed keys, or 0 if nodes cut off prefixes
+    explicit Tree(size_t);
+    virtual ~Tree();
+    virtual std::tuple<Ptr, Off, bool> find(const Key &) const = 0;
+    std::vector<Off> range(const Key *, bool, const Key *, bool) const;
+    Cursor seek(const Key *, bool, const Key *, bool) const;
     bool hasKey(const Key &) const;
-    void remove(const Key &) const;
-    void insert(const Key &, const Off &);
+    virtual void remove(const Key &) = 0;
+    virtual void insert(const Key &, const Off &) = 0;
+    // Inserts entries sorted by key. Each run of them that falls into one
+    // leaf costs a single descent and a single write of the leaf.
+    virtual void insertBatch(const std::vector<std::pair<Key, Off>> &) = 0;
+    void bulkLoad(const std::function<bool(Key &, Off &)> &, double);
 
-  private:
-    void insert_in_parent(const Ptr &, const Key &, const Ptr &);
+  protected:
+    friend struct Cursor;
+    friend struct NodeView;
+    std::mutex mutex; // guards the header
+    // Pages of internal nodes met by descents, pinned until released, so
+    // that the upper levels are reached without a buffer lookup. Writes go
+    // to the same pinned blocks, which keeps the cache current.
+    mutable BM::Latch innerLatch;
+    mutable std::unordered_map<Ptr, BM::PtrBlock> inner;
+    // pins a node's page; the flag tells whether it may still be kept
+    BM::PtrBlock pin(Ptr, bool &) const;
+    void keep(Ptr, const BM::PtrBlock &) const;
+    void writeHeader();
+    Ptr allocate();
+    void release(Ptr);
+    // descends to the first leaf of a new cursor / walks on from where the
+    // cursor stopped, as Cursor::next
+    virtual void start(Cursor &) const = 0;
+    virtual bool next(Cursor &, std::vector<Off> &, size_t,
+                      std::vector<Key> *) const = 0;
+    bool insertFirst(const Key &, const Off &);
+    void store(std::vector<Ptr> &, const Ptr &, Node &);
+    void insert_in_parent(std::vector<Ptr> &, const Ptr &, const Key &,
+                          const Ptr &);
+    void remove_entry(std::vector<Ptr> &, const Ptr &, Node &);
 };
 
+// Makes the tree for keys led by an attribute of the given type that all
+// have the given width, or 0 if their width varies: a tree of packed
+// integers for keys of four or eight bytes, one that compares the head of
+// its keys as an integer for CHAR keys, and one that compares bytes
+// otherwise.
+std::shared_ptr<Tree> makeTree(ValueType, size_t);
+
 } // namespace BPlusTree
 
-} // namespace IM
\ No newline at end of file
+} // namespace IM
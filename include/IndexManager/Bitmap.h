@@ -0,0 +1,75 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace IM {
+
+namespace Bitmap {
+
+// Keys are byte strings in the encoding of IndexManager/Key.h.
+using Key = std::string;
+using Off = uint32_t;
+
+// Most offsets a container keeps in an array; a fuller one keeps a bit for
+// each of its 65536 offsets, which takes the same 8KB as this many.
+constexpr size_t ARRAY_MAX = 4096;
+
+// Offsets sharing their upper 16 bits, by their lower 16 bits.
+struct Container {
+    std::vector<uint16_t> array; // in order, while not a bitmap
+    std::vector<uint64_t> bits;  // empty while an array
+    uint32_t count;
+    Container() : count(0) {}
+    bool isBitmap() const { return !bits.empty(); }
+    bool contains(uint16_t) const;
+    bool add(uint16_t);
+    bool remove(uint16_t);
+    void intersect(const Container &);
+
+  private:
+    void toBitmap();
+    void toArray();
+};
+
+// Compressed set of record offsets in the manner of Roaring bitmaps:
+// containers for the upper 16 bits in use, in order, each holding the
+// lower 16 bits as an array or a bitmap, whichever is smaller.
+struct Set {
+    std::vector<uint16_t> highs;
+    std::vector<Container> containers;
+    bool empty() const { return highs.empty(); }
+    size_t cardinality() const;
+    bool contains(Off) const;
+    void add(Off);
+    bool remove(Off);
+    // Keeps the offsets that are in the other set as well.
+    void intersect(const Set &);
+    // Appends the offsets in increasing order.
+    void offsets(std::vector<Off> &) const;
+    void write(std::ostream &) const;
+    void read(std::istream &);
+};
+
+// Index of a set of offsets for each distinct key. Kept in memory and
+// written to its file whole when it has changed.
+struct Index {
+    std::string filename;
+    std::map<Key, Set> sets;
+    bool dirty;
+    Index() : dirty(false) {}
+    void insert(const Key &, Off);
+    void remove(const Key &, Off);
+    // The set of a key, or nullptr if no record has it.
+    const Set *find(const Key &) const;
+    void load();
+    void save();
+};
+
+} // namespace Bitmap
+
+} // namespace IM
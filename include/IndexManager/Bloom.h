@@ -0,0 +1,60 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace IM {
+
+namespace Bloom {
+
+// Keys are byte strings in the encoding of IndexManager/Key.h.
+using Key = std::string;
+
+// Bits of a filter per key it is sized for, and bits set for each key; as
+// for the runs of the lsm engine, about 1% of the lookups of an absent key
+// get past a filter holding as many keys as it is sized for.
+constexpr uint32_t BITS_PER_KEY = 10;
+constexpr uint32_t NUM_PROBES = 7;
+
+// Fewest keys a filter is sized for.
+constexpr size_t MIN_CAPACITY = 1024;
+
+// Bloom filter of the key attributes of the entries of a B+tree index,
+// which tells that no entry has a key without a descent of the tree.
+// Removed keys stay in it. Once it holds more keys than it was sized for,
+// the index manager builds it again from the tree, twice the size.
+class Filter {
+  public:
+    std::string filename;
+
+    // Widths of the encoded key attributes, 0 for the NUL-terminated CHAR
+    // ones, so that the key of an entry can be told from what follows it.
+    explicit Filter(const std::vector<size_t> &);
+
+    // Empties the filter and sizes it for a number of keys.
+    void reset(size_t);
+    // Adds the key attributes an index entry starts with.
+    void add(const Key &);
+    // False if no entry added has the values of every key attribute.
+    bool mayContain(const Key &) const;
+    bool isFull() const;
+
+    // Reads back the filter from its file, which is used up, so that a
+    // crash leaves none behind. Returns false if it is missing.
+    bool load();
+    void save() const;
+
+  private:
+    mutable std::mutex mutex;
+    std::vector<size_t> widths;
+    uint32_t capacity;
+    uint32_t numKeys; // added since the filter was sized
+    std::vector<uint64_t> bits;
+    size_t keyLength(const Key &) const;
+};
+
+} // namespace Bloom
+
+} // namespace IM
@@ -0,0 +1,68 @@
+#pragma once
+#include <BufferManager/Block.h>
+#include <FileSpec.h>
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace IM {
+
+namespace Hash {
+
+using Ptr = uint32_t;
+constexpr Ptr NullPtr = 0U;
+// Keys are byte strings in the encoding of IndexManager/Key.h.
+using Key = std::string;
+using Off = uint32_t;
+
+// Deepest the directory grows. Buckets that fill up past it, or whose keys
+// all hash alike, chain overflow pages instead of splitting.
+constexpr uint32_t MAX_DEPTH = 20;
+
+// Decoded entries of a bucket page, or of a bucket with its overflow pages.
+struct Bucket {
+    uint32_t depth; // number of low hash bits shared by the keys
+    std::vector<uint32_t> hashes;
+    std::vector<Key> keys;
+    std::vector<Off> offsets;
+    Bucket() : depth(0) {}
+    void add(uint32_t, const Key &, Off);
+};
+
+// Extendible hash table. A directory of 2^depth bucket pointers, kept in
+// consecutive blocks, is indexed by the low bits of the hash of a key; a
+// full bucket splits in two by the next bit, doubling the directory when
+// it already uses all of them. Looking up a key reads one directory block
+// and one bucket page. A table that is not unique keeps an entry per
+// record for equal keys; they share a bucket, which chains overflow pages
+// once they outgrow it.
+struct Table {
+    std::string filename;
+    File::hashFileHeader header;
+    bool unique;
+    Table() : unique(true) {}
+    std::tuple<Off, bool> find(const Key &) const;
+    // Appends the offsets of every entry with the key.
+    void findAll(const Key &, std::vector<Off> &) const;
+    bool hasKey(const Key &) const;
+    // Removes the entry of a record; a unique table ignores the offset.
+    void remove(const Key &, const Off &);
+    void insert(const Key &, const Off &);
+
+  private:
+    void writeHeader();
+    Ptr allocate();
+    void release(Ptr);
+    Ptr bucketAt(uint32_t) const;
+    void setBucketAt(uint32_t, Ptr);
+    void grow();
+    void readPage(Ptr, Bucket &, Ptr &) const;
+    void writePage(Ptr, const Bucket &, Ptr);
+    Bucket readChain(Ptr, std::vector<Ptr> &) const;
+    void writeChain(std::vector<Ptr> &, const Bucket &);
+};
+
+} // namespace Hash
+
+} // namespace IM
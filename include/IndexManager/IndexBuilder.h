@@ -0,0 +1,46 @@
+#pragma once
+#include <BufferManager/BufferManager.h>
+#include <DataType.h>
+#include <IndexManager/BPlusTree.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace IM {
+
+// Bytes of entries sorted in memory before a run is spilled to disk, as
+// many as the buffer pool holds.
+constexpr size_t RUN_BYTES = BM::CACHE_SIZE * BM::BLOCK_SIZE;
+
+// Runs merged at once. When more are spilled, they are first merged into
+// a single longer run, so that few files are open at a time.
+constexpr size_t MERGE_WIDTH = 64;
+
+// Builds an empty index from (key, offset) pairs given in any order. The
+// pairs are sorted, spilling sorted runs to temporary files when they do
+// not fit in memory, and handed to the tree in key order so that it can
+// be packed bottom-up in one pass, each node filled to the fill factor.
+// The bloom filter of the index is built anew along the way.
+class IndexBuilder {
+  public:
+    IndexBuilder(const std::string &, double = BPlusTree::FILL_FACTOR);
+    ~IndexBuilder();
+    void add(const std::vector<Value> &, const uint32_t);
+    void build();
+
+  private:
+    using Entry = std::pair<BPlusTree::Key, BPlusTree::Off>;
+    std::string indexName;
+    double fillFactor;
+    Index index;
+    std::shared_ptr<BPlusTree::Tree> tree;
+    std::vector<Entry> run;
+    size_t runBytes;
+    std::vector<std::string> runFiles;
+    size_t numRuns; // spilled so far, which numbers the next file
+    size_t numEntries;
+    void spill();
+    void mergeRuns();
+};
+
+} // namespace IM
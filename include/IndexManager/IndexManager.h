@@ -1,15 +1,85 @@
 #pragma once
 #include <BufferManager/BufferManager.h>
+#include <DataType.h>
+#include <IndexManager/ART.h>
+#include <IndexManager/BPlusTree.h>
+#include <IndexManager/Bitmap.h>
+#include <IndexManager/Bloom.h>
+#include <IndexManager/Hash.h>
+#include <functional>
+#include <memory>
+#include <vector>
 
 namespace IM {
 
+// Number of offsets an index scan pulls from the leaf chain at a time.
+constexpr size_t SCAN_BATCH = 256;
+
+// Inserts a buffered index holds in memory before adding them to its tree.
+// Scans add them first, and so does exit.
+constexpr size_t DELTA_SIZE = 4096;
+
 void init();
 void exit();
 
 bool hasIndex(const std::string &);
 
-void createIndex(const std::string &, const std::string &, const std::string &);
+void createIndex(const std::string &, const std::string &,
+                 const std::vector<std::string> &);
 
 void dropIndex(const std::string &);
 
+std::shared_ptr<BPlusTree::Tree> openTree(const std::string &);
+
+std::shared_ptr<Hash::Table> openTable(const std::string &);
+
+// The bloom filter of a B+tree or buffered index, read back from its file
+// or built from the tree on first use.
+std::shared_ptr<Bloom::Filter> openBloom(const std::string &);
+
+void clearIndex(const std::string &);
+
+// Entry of a record in a B+tree index, given the values of its key
+// attributes followed by those of its included attributes. Keys of a
+// non-unique index are followed by the record offset, so that equal values
+// become distinct entries next to each other; included attributes come
+// last, where they do not change the order of the keys.
+BPlusTree::Key treeKey(const Index &, const std::vector<Value> &,
+                       const uint32_t);
+
+// Keys are given as the values of the index attributes in order, then of
+// the included attributes, along with the offset of their record.
+void insertKey(const std::string &, const std::vector<Value> &,
+               const uint32_t);
+
+void removeKey(const std::string &, const std::vector<Value> &,
+               const uint32_t);
+
+bool hasKey(const std::string &, const std::vector<Value> &);
+
+// Predicates may be on any attributes; equalities on leading attributes
+// and a range on the one after them narrow the scan. Hash and bitmap
+// indexes take equalities on all of their attributes.
+std::vector<uint32_t> search(const std::string &,
+                             const std::vector<Predicate> &);
+
+// Hands the offset of every record in a B+tree index satisfying the
+// predicates to the visitor, along with the values of its key and included
+// attributes as stored in the index, in key order.
+void scanEntries(const std::string &, const std::vector<Predicate> &,
+                 const std::function<void(uint32_t, const Record &)> &);
+
+// Opens a cursor over the keys satisfying the predicates, in key order.
+// Only B+tree indexes can be scanned.
+BPlusTree::Cursor seek(const std::string &, const std::vector<Predicate> &);
+
+// Offsets of the records that the predicates fix every attribute of each
+// of the bitmap indexes for, in increasing order. The bitmaps of the
+// values are intersected, so no record is read.
+std::vector<uint32_t> intersect(const std::vector<std::string> &,
+                                const std::vector<Predicate> &);
+
+// Bytes of memory an art index takes; other indexes live in their files.
+size_t footprint(const std::string &);
+
 } // namespace IM
@@ -0,0 +1,34 @@
+#pragma once
+#include <DataType.h>
+#include <string>
+#include <vector>
+
+namespace IM {
+
+// Width of a value in its key encoding.
+size_t encodedWidth(ValueType, size_t);
+
+// Appends a value so that encoded keys compare byte by byte in the order
+// of their values, attribute after attribute, and any two keys compare
+// with a single memcmp. INT and FLOAT are written big-endian with the sign
+// flipped to sort first, FLOAT NaNs as one value above infinity; CHAR
+// strings are written with a terminating NUL, which sorts a string before
+// its extensions.
+void encodeValue(std::string &, const Value &);
+
+// Appends a value like encodeValue, except that -0.0 keeps its sign, for
+// attributes stored along with a key rather than ordered by.
+void encodeExactValue(std::string &, const Value &);
+
+// Reads back a value written by encodeValue into `value`, which gives the
+// type and length. Returns the number of bytes read.
+size_t decodeValue(const char *, Value &);
+
+// Encodes values for all or the leading attributes of a key.
+std::string encodeKey(const std::vector<Value> &);
+
+// Appends a record offset to a key of a non-unique index, which makes the
+// keys distinct and orders duplicates by offset.
+void encodeOffset(std::string &, uint32_t);
+
+} // namespace IM
@@ -26,11 +26,13 @@ class CreateTableStatement : public Statement {
     std::string tableName;
     std::string primaryKey;
     std::vector<Attribute> attributes;
+    TableEngine engine = TableEngine::HEAP;
 
   public:
     void setTableName(const std::string &);
     void addAttribute(const Attribute &);
     void addPrimaryKey(const std::string &);
+    void setEngine(const TableEngine);
     void callAPI() const override;
 };
 
@@ -47,12 +49,18 @@ class CreateIndexStatement : public Statement {
   private:
     std::string indexName;
     std::string tableName;
-    std::string attrName;
+    std::vector<std::string> attrNames;
+    std::vector<std::string> includeNames;
+    IndexType type = IndexType::BTREE;
+    int fillFactor = 0;
 
   public:
     void setIndexName(const std::string &);
     void setTableName(const std::string &);
-    void setAttrName(const std::string &);
+    void addAttrName(const std::string &);
+    void addIncludeName(const std::string &);
+    void setIndexType(const IndexType);
+    void setFillFactor(const int);
     void callAPI() const override;
 };
 
@@ -70,11 +78,15 @@ class SelectStatement : public Statement {
     std::vector<std::string> attributes;
     std::string tableName;
     std::vector<Predicate> predicates;
+    int limit = -1;
+    int offset = 0;
 
   public:
     void setTableName(const std::string &);
     void addAttrName(const std::string &);
     void addPredicate(const Predicate &);
+    void setLimit(const int);
+    void setOffset(const int);
     void callAPI() const override;
 };
 
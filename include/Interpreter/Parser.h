@@ -24,6 +24,7 @@ class Parser {
     Predicate getPredicate();
     Value getValue();
     int getInteger();
+    int getCount();
     float getFloating();
     std::string getString();
     void raise(const std::string &);
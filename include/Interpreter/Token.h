@@ -9,22 +9,29 @@ enum class Keyword {
     CREATE,
     DELETE,
     DROP,
+    ENGINE,
     EXECFILE,
+    FILLFACTOR,
     FLOAT,
     FROM,
+    INCLUDE,
     INDEX,
     INSERT,
     INT,
     INTO,
     KEY,
+    LIMIT,
+    OFFSET,
     ON,
     PRIMARY,
     QUIT,
     SELECT,
     TABLE,
     UNIQUE,
+    USING,
     VALUES,
-    WHERE
+    WHERE,
+    WITH
 };
 
 enum class Symbol {
@@ -0,0 +1,66 @@
+#pragma once
+#include <DataType.h>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace RM {
+
+// Storage of the tables created with `engine = lsm`. Records are images in
+// the layout of the heap file, kept by their encoded primary key. They are
+// known by an id handed out in insertion order rather than by their
+// offset, which the word in front of them holds. New records and deletions
+// go into a memtable sorted by key; a full memtable is written out as an
+// immutable run, sorted by key, with the first key of each block and a
+// bloom filter of its keys. Enough runs are merged into one on a
+// background thread, which drops deleted records for good. A lookup of a
+// key tries the memtable, then the runs from the newest that the filter
+// does not rule out. Like the memory engine, a table maps the ids of its
+// live records to their keys in memory, which its runs are read through
+// once when it is opened.
+namespace LSM {
+
+// Records and deletions a table holds in memory before writing a run.
+constexpr size_t MEMTABLE_SIZE = 4096;
+
+// Runs at which all of them are merged into one.
+constexpr size_t MERGE_RUNS = 4;
+
+// Bits of a run's bloom filter per entry; with 7 probes about 1% of the
+// lookups of a key that is not in the run read one of its blocks.
+constexpr uint32_t BLOOM_BITS = 10;
+constexpr uint32_t BLOOM_PROBES = 7;
+
+// Opens the runs of a table and maps the ids of its records.
+void open(std::shared_ptr<Schema>);
+
+void createTable(std::shared_ptr<Schema>);
+void dropTable(const std::string &);
+
+// Stores a record image and returns the id of the record. The primary key
+// must not be taken.
+uint32_t insert(const std::string &, std::string);
+
+// Copies the image of the record with the id, if it has not been deleted.
+bool get(const std::string &, uint32_t, std::string &);
+
+// Finds the id of the record whose primary key has the value.
+bool find(const std::string &, const Value &, uint32_t &);
+
+void erase(const std::string &, uint32_t);
+
+// Deletes every record and returns how many there were.
+int clear(const std::string &);
+
+// Visits the images of the records in primary key order until `visit`
+// returns false.
+void scan(const std::string &,
+          const std::function<bool(uint32_t, const char *)> &);
+
+// Waits for the merges and writes out the memtables.
+void exit();
+
+} // namespace LSM
+
+} // namespace RM
@@ -0,0 +1,55 @@
+#pragma once
+#include <DataType.h>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace RM {
+
+// Storage of the tables created with `engine = memory`. Record images, in
+// the layout of the heap file, are packed into fixed-size pages of an
+// in-process arena and known by their slot in it, counted from 1, which
+// stands in for their offset. A hash table maps the encoded primary key of
+// each record to its slot. Nothing goes through the buffer manager: the
+// live records are written to a snapshot file on exit and read back
+// whole on init.
+namespace Memory {
+
+// Records to a page of the arena.
+constexpr size_t PAGE_RECORDS = 1024;
+
+bool hasTable(const std::string &);
+
+// Loads the snapshot of a table.
+void open(std::shared_ptr<Schema>);
+
+void createTable(std::shared_ptr<Schema>);
+void dropTable(const std::string &);
+
+// Stores a record image and returns its slot. The primary key must not be
+// taken.
+uint32_t insert(const std::string &, const char *);
+
+// The image in a slot, or nullptr if it has been deleted.
+const char *get(const std::string &, uint32_t);
+
+// Finds the slot of the record whose primary key has the value.
+bool find(const std::string &, const Value &, uint32_t &);
+
+void erase(const std::string &, uint32_t);
+
+// Deletes every record and returns how many there were.
+int clear(const std::string &);
+
+// Visits the images of the records in slot order, which is insertion
+// order, until `visit` returns false.
+void scan(const std::string &,
+          const std::function<bool(uint32_t, const char *)> &);
+
+// Writes the snapshots.
+void exit();
+
+} // namespace Memory
+
+} // namespace RM
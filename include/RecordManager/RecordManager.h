@@ -2,6 +2,7 @@
 #include <BufferManager/BufferManager.h>
 #include <CatalogManager/CatalogManager.h>
 #include <DataType.h>
+#include <functional>
 #include <string>
 
 namespace RM {
@@ -15,14 +16,27 @@ void dropTable(const std::string &);
 uint32_t insertRecord(const std::string &, const Record &);
 int deleteAllRecords(const std::string &);
 int deleteRecords(const std::string &, const std::vector<uint32_t> &);
-int deleteRecords(std::shared_ptr<Schema>, const std::vector<Predicate> &);
 std::vector<Record> selectRecords(std::shared_ptr<Schema>,
-                                  const std::vector<Predicate> &);
+                                  const std::vector<Predicate> &,
+                                  const std::vector<std::string> &, int, int);
 std::vector<Record> selectRecordsWithOffsets(std::shared_ptr<Schema>,
                                              const std::vector<Predicate> &,
-                                             const std::vector<uint32_t> &);
-std::vector<Record> project(const std::vector<Record> &,
-                            std::shared_ptr<Schema>,
-                            const std::vector<std::string> &);
+                                             const std::vector<uint32_t> &,
+                                             const std::vector<std::string> &,
+                                             int, int);
+void scanRecords(std::shared_ptr<Schema>, const std::vector<std::string> &,
+                 const std::function<void(uint32_t, const Record &)> &);
+void fetchRecords(std::shared_ptr<Schema>, const std::vector<uint32_t> &,
+                  const std::vector<std::string> &,
+                  const std::function<void(uint32_t, const Record &)> &);
+std::vector<uint32_t> selectOffsets(std::shared_ptr<Schema>,
+                                    const std::vector<Predicate> &);
+std::vector<uint32_t> selectOffsets(std::shared_ptr<Schema>,
+                                    const std::vector<Predicate> &,
+                                    const std::vector<uint32_t> &);
+
+// Finds the offset of the record with a primary key value in a table of the
+// memory or lsm engine, which needs no index for it.
+bool findPrimaryKey(const std::string &, const Value &, uint32_t &);
 
 } // namespace RM
@@ -0,0 +1,76 @@
+#pragma once
+#include <DataType.h>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace RM {
+
+// Summaries of the data blocks of heap tables, so that a scan can skip the
+// blocks that hold no record satisfying its predicates. Each block keeps
+// the number of records written to it and, for every column, bounds on
+// the values in it as the leading bytes of their key encoding, which keep
+// the order of the values. Deleting records leaves the bounds as they are,
+// wider than need be but never wrong. The summaries live in memory, are
+// written to a file of their own on exit, and are rebuilt from the heap
+// file when that is missing or out of date.
+namespace Zone {
+
+// Bytes of a bound. INT and FLOAT values fit whole, CHAR ones are cut.
+constexpr size_t PREFIX = 8;
+
+// Predicates of a scan a summary can rule out, by column, with their
+// values as bounds are.
+using Filter = std::vector<std::tuple<int, OpType, std::string>>;
+
+class Map {
+  public:
+    explicit Map(const Schema &);
+
+    // Where the next record of the table goes, as of the summaries.
+    uint32_t availableOffset;
+
+    // Folds a record image written to a data block into its summary.
+    void add(uint32_t, const char *);
+    void clear();
+
+    Filter makeFilter(const std::vector<Predicate> &) const;
+    // Whether a data block may hold a record satisfying the predicates.
+    bool mayMatch(uint32_t, const Filter &) const;
+
+    void write(std::ostream &) const;
+    // Returns false if the summaries read are not those of the table.
+    bool read(std::istream &);
+
+  private:
+    std::vector<Attribute> columns;
+    std::vector<uint32_t> offsets; // of the columns in a record image
+    std::vector<uint32_t> counts;  // by block, from block 1
+    std::string lows;              // PREFIX bytes by column, by block
+    std::string highs;
+};
+
+// Sets up the summaries of a table as read back from their file, which is
+// used up, so that a crash leaves none behind. Returns false, leaving them
+// empty, if the file is missing or its available offset is not the one
+// given.
+bool load(const Schema &, uint32_t);
+
+// Sets up empty summaries of a table, whose file is gone.
+void reset(const Schema &);
+
+// The summaries of a table that has been set up, or nullptr.
+Map *find(const std::string &);
+
+void drop(const std::string &);
+
+// Writes the summaries set up.
+void exit();
+
+} // namespace Zone
+
+} // namespace RM
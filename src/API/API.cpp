@@ -1,30 +1,344 @@
 #include <API/API.h>
 #include <CatalogManager/CatalogManager.h>
+#include <Error.h>
+#include <IndexManager/IndexBuilder.h>
 #include <IndexManager/IndexManager.h>
 #include <RecordManager/RecordManager.h>
+#include <algorithm>
+#include <tuple>
+
+// Picks an index that can narrow down the rows matching `predicates`. An
+// index scores by how many of its leading attributes equalities fix, then
+// by whether a range bounds the next one. Ties go to the narrowest index,
+// then to art, hash, B+tree and bitmap indexes in that order; hash and
+// bitmap indexes need all of their attributes fixed. The predicates on the
+// chosen index come back in `indexPredicates`; an empty name means a scan.
+static std::string chooseIndex(const std::string &tableName,
+                               const std::vector<Predicate> &predicates,
+                               std::vector<Predicate> &indexPredicates) {
+    auto hasPredicate = [&](const std::string &attrName, bool equality) {
+        return std::any_of(predicates.begin(), predicates.end(),
+                           [&](const Predicate &predicate) -> bool {
+                               return predicate.attrName == attrName &&
+                                      predicate.op != OpType::NE &&
+                                      (predicate.op == OpType::EQ) == equality;
+                           });
+    };
+    Index best;
+    std::tuple<size_t, bool, int, int> bestScore(0, false, 0, 0);
+    for (auto &index : CM::getIndices(tableName)) {
+        auto &attrNames = index.attrNames;
+        size_t numEqual = 0;
+        while (numEqual < attrNames.size() &&
+               hasPredicate(attrNames[numEqual], true)) {
+            numEqual++;
+        }
+        bool hasRange = numEqual < attrNames.size() &&
+                        hasPredicate(attrNames[numEqual], false);
+        bool isHash = index.type == IndexType::HASH;
+        bool isBitmap = index.type == IndexType::BITMAP;
+        if ((isHash || isBitmap) && numEqual < attrNames.size()) {
+            continue;
+        }
+        int rank = index.type == IndexType::ART ? 2
+                   : isHash                     ? 1
+                   : isBitmap                   ? -1
+                                                : 0;
+        std::tuple<size_t, bool, int, int> score(
+            numEqual, hasRange, -static_cast<int>(attrNames.size()), rank);
+        if ((numEqual > 0 || hasRange) &&
+            (best.indexName.empty() || score > bestScore ||
+             (score == bestScore && index.indexName < best.indexName))) {
+            best = index;
+            bestScore = score;
+        }
+    }
+    indexPredicates.clear();
+    for (auto &predicate : predicates) {
+        auto &attrNames = best.attrNames;
+        if (std::find(attrNames.begin(), attrNames.end(),
+                      predicate.attrName) != attrNames.end()) {
+            indexPredicates.push_back(predicate);
+        }
+    }
+    return best.indexName;
+}
+
+// Whether the predicates fix every attribute of an index by equalities.
+static bool fixes(const Index &index,
+                  const std::vector<Predicate> &predicates) {
+    return std::all_of(
+        index.attrNames.begin(), index.attrNames.end(),
+        [&](const std::string &attrName) -> bool {
+            return std::any_of(predicates.begin(), predicates.end(),
+                               [&](const Predicate &predicate) -> bool {
+                                   return predicate.attrName == attrName &&
+                                          predicate.op == OpType::EQ;
+                               });
+        });
+}
+
+// Offsets of the records that an index narrows the predicates down to, in
+// file order. A bitmap index is intersected with every other bitmap index
+// on the table whose attributes the predicates fix, before any record is
+// read.
+static std::vector<uint32_t>
+lookup(const Index &index, const std::vector<Predicate> &predicates,
+       const std::vector<Predicate> &indexPredicates) {
+    if (index.type == IndexType::BITMAP) {
+        std::vector<std::string> indexNames;
+        for (auto &other : CM::getIndices(index.tableName)) {
+            if (other.type == IndexType::BITMAP && fixes(other, predicates)) {
+                indexNames.push_back(other.indexName);
+            }
+        }
+        return IM::intersect(indexNames, predicates);
+    }
+    auto offsets = IM::search(index.indexName, indexPredicates);
+    std::sort(offsets.begin(), offsets.end());
+    return offsets;
+}
+
+// Offsets of the records that the predicates allow in a table of the
+// memory or lsm engine, when they fix its primary key, which it looks up
+// itself.
+static bool findPrimaryKey(const Schema &schema,
+                           const std::vector<Predicate> &predicates,
+                           std::vector<uint32_t> &offsets) {
+    if (schema.engine == TableEngine::HEAP) {
+        return false;
+    }
+    for (auto &predicate : predicates) {
+        if (predicate.attrName == schema.primaryKey &&
+            predicate.op == OpType::EQ) {
+            uint32_t offset;
+            offsets.clear();
+            if (RM::findPrimaryKey(schema.tableName, predicate.val, offset)) {
+                offsets.push_back(offset);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// Values of the key and included attributes of an index in a record
+// holding `attributes`.
+static std::vector<Value> keyValues(const Index &index,
+                                    const std::vector<std::string> &attributes,
+                                    const Record &record) {
+    std::vector<Value> values;
+    for (auto &attrName : index.columns()) {
+        auto i = std::find(attributes.begin(), attributes.end(), attrName) -
+                 attributes.begin();
+        values.push_back(record[i]);
+    }
+    return values;
+}
+
+static int attrPosition(const Schema &schema, const std::string &attrName) {
+    for (size_t i = 0; i < schema.attributes.size(); i++) {
+        if (schema.attributes[i].name == attrName) {
+            return i;
+        }
+    }
+    throw SQLError("cannot find attribute \'" + attrName + "\' in table \'" +
+                   schema.tableName + "\'");
+}
+
+// Whether a B+tree index holds every attribute that a query reads, so that
+// the query can be answered from its leaves alone. No attributes stand for
+// all of them. A FLOAT key stores -0.0 as 0.0, so it can be filtered on but
+// not returned.
+static bool covers(const Index &index, const Schema &schema,
+                   const std::vector<std::string> &attributes,
+                   const std::vector<Predicate> &predicates) {
+    if (index.type != IndexType::BTREE && index.type != IndexType::BUFFERED) {
+        return false;
+    }
+    auto columns = index.columns();
+    auto has = [&](const std::string &attrName) {
+        return std::find(columns.begin(), columns.end(), attrName) !=
+               columns.end();
+    };
+    auto returns = [&](const std::string &attrName) {
+        if (std::find(index.attrNames.begin(), index.attrNames.end(),
+                      attrName) == index.attrNames.end()) {
+            return has(attrName);
+        }
+        return schema.attributes[attrPosition(schema, attrName)].type !=
+               ValueType::FLOAT;
+    };
+    if (attributes.empty()) {
+        if (!std::all_of(schema.attributes.begin(), schema.attributes.end(),
+                         [&](const Attribute &attribute) -> bool {
+                             return returns(attribute.name);
+                         })) {
+            return false;
+        }
+    } else if (!std::all_of(attributes.begin(), attributes.end(), returns)) {
+        return false;
+    }
+    return std::all_of(predicates.begin(), predicates.end(),
+                       [&](const Predicate &predicate) -> bool {
+                           return has(predicate.attrName);
+                       });
+}
+
+// Answers a query from the entries of a covering index. Rows come back in
+// file order, as a scan of a heap or memory table returns them.
+static std::vector<Record>
+selectFromIndex(const Index &index, const Schema &schema,
+                const std::vector<std::string> &attributes,
+                const std::vector<Predicate> &predicates,
+                const std::vector<Predicate> &indexPredicates, int limit,
+                int offset) {
+    auto columns = index.columns();
+    auto slot = [&](const std::string &attrName) -> int {
+        return std::find(columns.begin(), columns.end(), attrName) -
+               columns.begin();
+    };
+    std::vector<std::pair<int, const Predicate *>> filters;
+    for (auto &predicate : predicates) {
+        filters.emplace_back(slot(predicate.attrName), &predicate);
+    }
+    std::vector<int> projection;
+    if (attributes.empty()) {
+        for (auto &attribute : schema.attributes) {
+            projection.push_back(slot(attribute.name));
+        }
+    } else {
+        for (auto &attrName : attributes) {
+            projection.push_back(slot(attrName));
+        }
+    }
+    std::vector<std::pair<uint32_t, Record>> rows;
+    IM::scanEntries(
+        index.indexName, indexPredicates,
+        [&](uint32_t offset, const Record &row) {
+            for (auto &filter : filters) {
+                if (!filter.second->satisfiedBy(row[filter.first])) {
+                    return;
+                }
+            }
+            Record projected;
+            projected.reserve(projection.size());
+            for (int i : projection) {
+                projected.push_back(row[i]);
+            }
+            rows.emplace_back(offset, std::move(projected));
+        });
+    std::sort(rows.begin(), rows.end(),
+              [](const std::pair<uint32_t, Record> &lhs,
+                 const std::pair<uint32_t, Record> &rhs) -> bool {
+                  return lhs.first < rhs.first;
+              });
+    std::vector<Record> records;
+    for (size_t i = offset; i < rows.size(); i++) {
+        if (limit >= 0 && records.size() >= static_cast<size_t>(limit)) {
+            break;
+        }
+        records.push_back(std::move(rows[i].second));
+    }
+    return records;
+}
 
 void API::createTable(const std::string &tableName,
                       const std::string &primaryKey,
-                      const std::vector<Attribute> &attributes) {
-    CM::createTable(tableName, primaryKey, attributes);
+                      const std::vector<Attribute> &attributes,
+                      const TableEngine engine) {
+    CM::createTable(tableName, primaryKey, attributes, engine);
     RM::createTable(tableName);
-    createIndex(File::defaultIndexName(tableName, primaryKey), tableName,
-                primaryKey);
+    // the records of an lsm table are written out in batches; so are the
+    // entries of its indexes
+    auto type = engine == TableEngine::LSM ? IndexType::BUFFERED
+                                           : IndexType::BTREE;
+    // the other engines look up their primary key themselves
+    if (engine == TableEngine::HEAP) {
+        createIndex(File::defaultIndexName(tableName, primaryKey), tableName,
+                    {primaryKey}, type);
+    }
+    for (auto &attribute : attributes) {
+        if (attribute.isUnique && attribute.name != primaryKey) {
+            createIndex(File::defaultIndexName(tableName, attribute.name),
+                        tableName, {attribute.name}, type);
+        }
+    }
 }
 
 void API::dropTable(const std::string &tableName) {
+    for (auto &index : CM::getIndices(tableName)) {
+        CM::dropIndex(index.indexName);
+        IM::dropIndex(index.indexName);
+    }
     CM::dropTable(tableName);
     RM::dropTable(tableName);
 }
 
 void API::createIndex(const std::string &indexName,
                       const std::string &tableName,
-                      const std::string &attrName) {
-    CM::createIndex(indexName, tableName, attrName);
-    IM::createIndex(indexName, tableName, attrName);
+                      const std::vector<std::string> &attrNames,
+                      const IndexType type,
+                      const std::vector<std::string> &includeNames,
+                      const int fillFactor) {
+    if (fillFactor != 0 && type != IndexType::BTREE &&
+        type != IndexType::BUFFERED) {
+        throw SQLError("only B+tree indexes have a fill factor");
+    }
+    CM::createIndex(indexName, tableName, attrNames, type, includeNames);
+    // an art index is filled by the index manager, which also does so on
+    // every start
+    IM::createIndex(indexName, tableName, attrNames);
+    if (type == IndexType::ART) {
+        return;
+    }
+    auto schema = CM::getSchema(tableName);
+    auto columns = CM::mapIndices.at(indexName).columns();
+    if (type == IndexType::HASH || type == IndexType::BITMAP) {
+        // neither a hash file nor bitmaps have an order to build them in
+        RM::scanRecords(schema, columns,
+                        [&](uint32_t offset, const Record &record) {
+                            IM::insertKey(indexName, record, offset);
+                        });
+        return;
+    }
+    IM::IndexBuilder builder(indexName, fillFactor != 0
+                                            ? fillFactor / 100.0
+                                            : IM::BPlusTree::FILL_FACTOR);
+    RM::scanRecords(schema, columns,
+                    [&](uint32_t offset, const Record &record) {
+                        builder.add(record, offset);
+                    });
+    builder.build();
+}
+
+size_t API::indexFootprint(const std::string &indexName) {
+    return IM::footprint(indexName);
 }
 
 void API::dropIndex(const std::string &indexName) {
+    // the last index on a unique attribute alone is what inserts check the
+    // constraint against
+    auto iter = CM::mapIndices.find(indexName);
+    if (iter != CM::mapIndices.end() && iter->second.attrNames.size() == 1) {
+        auto &index = iter->second;
+        auto schema = CM::getSchema(index.tableName);
+        auto &attribute = schema->attributes[attrPosition(
+            *schema, index.attrNames[0])];
+        bool ownKey = schema->engine != TableEngine::HEAP &&
+                      attribute.name == schema->primaryKey;
+        auto indices = CM::getIndices(index.tableName);
+        if (attribute.isUnique && !ownKey &&
+            std::count_if(indices.begin(), indices.end(),
+                          [&](const Index &other) {
+                              return other.attrNames == index.attrNames;
+                          }) == 1) {
+            throw SQLError("index \'" + indexName +
+                           "\' enforces unique attribute \'" +
+                           attribute.name + "\' of table \'" +
+                           index.tableName + "\'");
+        }
+    }
     CM::dropIndex(indexName);
     IM::dropIndex(indexName);
 }
@@ -32,26 +346,142 @@ void API::dropIndex(const std::string &indexName) {
 std::pair<std::shared_ptr<Schema>, std::vector<Record>>
 API::select(const std::vector<std::string> &attributes,
             const std::string &tableName,
-            const std::vector<Predicate> &predicates) {
+            const std::vector<Predicate> &predicates, int limit,
+            int offset) {
     CM::checkPredicates(tableName, predicates);
     auto schema = CM::getSchema(tableName);
-    auto records =
-        RM::project(RM::selectRecords(schema, predicates), schema, attributes);
+    std::vector<Predicate> indexPredicates;
+    auto indexName = chooseIndex(tableName, predicates, indexPredicates);
+    if (indexName.empty() && limit < 0) {
+        // the narrowest covering index is read in full instead of the
+        // table; with a limit, a scan of the table can stop early
+        size_t numColumns = 0;
+        for (auto &index : CM::getIndices(tableName)) {
+            auto num = index.columns().size();
+            if (covers(index, *schema, attributes, predicates) &&
+                (indexName.empty() || num < numColumns)) {
+                indexName = index.indexName;
+                numColumns = num;
+            }
+        }
+    }
+    std::vector<Record> records;
+    std::vector<uint32_t> offsets;
+    if (findPrimaryKey(*schema, predicates, offsets)) {
+        records = RM::selectRecordsWithOffsets(schema, predicates, offsets,
+                                               attributes, limit, offset);
+    } else if (!indexName.empty() &&
+               covers(CM::mapIndices.at(indexName), *schema, attributes,
+                      predicates)) {
+        records = selectFromIndex(CM::mapIndices.at(indexName), *schema,
+                                  attributes, predicates, indexPredicates,
+                                  limit, offset);
+    } else if (indexName.empty()) {
+        records =
+            RM::selectRecords(schema, predicates, attributes, limit, offset);
+    } else {
+        // fetch in file order, which a scan of a heap or memory table
+        // returns too
+        auto offsets = lookup(CM::mapIndices.at(indexName), predicates,
+                              indexPredicates);
+        records = RM::selectRecordsWithOffsets(schema, predicates, offsets,
+                                               attributes, limit, offset);
+    }
     return std::make_pair(schema, records);
 }
 
 void API::insert(const std::string &tableName,
                  const std::vector<Value> &values) {
-    RM::insertRecord(tableName, values);
+    auto schema = CM::getSchema(tableName);
+    for (size_t i = 0; i < values.size() && i < schema->attributes.size();
+         i++) {
+        auto &attribute = schema->attributes[i];
+        if (!attribute.isUnique) {
+            continue;
+        }
+        if (schema->engine != TableEngine::HEAP &&
+            attribute.name == schema->primaryKey) {
+            uint32_t offset;
+            if (values[i].type == attribute.type &&
+                RM::findPrimaryKey(tableName, values[i], offset)) {
+                throw SQLError("duplicate value " + values[i].toString() +
+                               " for unique attribute \'" + attribute.name +
+                               "\'");
+            }
+            continue;
+        }
+        // create table backs unique attributes with an index that cannot
+        // be dropped, so that the check costs one descent instead of a scan
+        auto indexName = CM::hasIndex(tableName, attribute.name);
+        if (indexName.empty()) {
+            throw SysError("missing index for unique attribute \'" +
+                           attribute.name + "\'");
+        }
+        if (values[i].type == attribute.type &&
+            IM::hasKey(indexName, {values[i]})) {
+            throw SQLError("duplicate value " + values[i].toString() +
+                           " for unique attribute \'" + attribute.name + "\'");
+        }
+    }
+    auto offset = RM::insertRecord(tableName, values);
+    for (auto &index : CM::getIndices(tableName)) {
+        std::vector<Value> key;
+        for (auto &attrName : index.columns()) {
+            key.push_back(values[attrPosition(*schema, attrName)]);
+        }
+        IM::insertKey(index.indexName, key, offset);
+    }
 }
 
 int API::deleteFrom(const std::string &tableName,
                     const std::vector<Predicate> &predicates) {
+    auto indices = CM::getIndices(tableName);
     if (predicates.empty()) {
+        for (auto &index : indices) {
+            IM::clearIndex(index.indexName);
+        }
         return RM::deleteAllRecords(tableName);
+    }
+    CM::checkPredicates(tableName, predicates);
+    auto schema = CM::getSchema(tableName);
+    std::vector<Predicate> indexPredicates;
+    auto indexName = chooseIndex(tableName, predicates, indexPredicates);
+    std::vector<uint32_t> offsets;
+    if (findPrimaryKey(*schema, predicates, offsets)) {
+        offsets = RM::selectOffsets(schema, predicates, offsets);
+    } else if (indexName.empty()) {
+        offsets = RM::selectOffsets(schema, predicates);
     } else {
-        CM::checkPredicates(tableName, predicates);
-        auto schema = CM::getSchema(tableName);
-        return RM::deleteRecords(schema, predicates);
+        offsets = lookup(CM::mapIndices.at(indexName), predicates,
+                         indexPredicates);
+        offsets = RM::selectOffsets(schema, predicates, offsets);
+    }
+    if (indices.empty()) {
+        return RM::deleteRecords(tableName, offsets);
+    }
+
+    // keys have to be read before the records are marked as deleted
+    std::vector<std::string> attrNames;
+    for (auto &index : indices) {
+        for (auto &attrName : index.columns()) {
+            if (std::find(attrNames.begin(), attrNames.end(), attrName) ==
+                attrNames.end()) {
+                attrNames.push_back(attrName);
+            }
+        }
+    }
+    std::vector<std::pair<uint32_t, Record>> records;
+    RM::fetchRecords(schema, offsets, attrNames,
+                     [&](uint32_t offset, const Record &record) {
+                         records.emplace_back(offset, record);
+                     });
+    int numDeleted = RM::deleteRecords(tableName, offsets);
+    for (auto &record : records) {
+        for (auto &index : indices) {
+            IM::removeKey(index.indexName,
+                          keyValues(index, attrNames, record.second),
+                          record.first);
+        }
     }
+    return numDeleted;
 }
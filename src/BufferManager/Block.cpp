@@ -3,18 +3,99 @@
 #include <cstdint>
 #include <cstring>
 #include <fstream>
+#include <thread>
 using namespace std;
 
 namespace BM {
 
+void Latch::lockShared() {
+    for (;;) {
+        int curr = state.load(std::memory_order_relaxed);
+        if (curr >= 0 && waiting.load(std::memory_order_relaxed) == 0 &&
+            state.compare_exchange_weak(curr, curr + 1,
+                                        std::memory_order_acquire)) {
+            return;
+        }
+        std::this_thread::yield();
+    }
+}
+
+void Latch::unlockShared() { state.fetch_sub(1, std::memory_order_release); }
+
+void Latch::acquire() {
+    waiting++;
+    for (;;) {
+        int expected = 0;
+        if (state.compare_exchange_weak(expected, -1,
+                                        std::memory_order_acquire)) {
+            break;
+        }
+        std::this_thread::yield();
+    }
+    waiting--;
+}
+
+// An odd version tells optimistic readers that the data may be changing;
+// the fence keeps the writes that follow from being seen before it.
+void Latch::lock() {
+    acquire();
+    version.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void Latch::unlock() {
+    version.fetch_add(1, std::memory_order_release);
+    state.store(0, std::memory_order_release);
+}
+
+uint64_t Latch::stableVersion() const {
+    for (;;) {
+        uint64_t curr = version.load(std::memory_order_acquire);
+        if ((curr & 1) == 0) {
+            return curr;
+        }
+        std::this_thread::yield();
+    }
+}
+
+// The fence keeps the reads of the data before it from being done after
+// the version is read again.
+bool Latch::validate(uint64_t expected) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return version.load(std::memory_order_relaxed) == expected;
+}
+
+bool Latch::lockSharedAt(uint64_t expected) {
+    if (!validate(expected)) {
+        return false;
+    }
+    lockShared();
+    if (version.load(std::memory_order_relaxed) != expected) {
+        unlockShared();
+        return false;
+    }
+    return true;
+}
+
+// A latch taken for a version that is gone is let go of without a version
+// of its own, so that it does not fail other readers in turn.
+bool Latch::lockAt(uint64_t expected) {
+    if (!validate(expected)) {
+        return false;
+    }
+    acquire();
+    if (version.load(std::memory_order_relaxed) != expected) {
+        state.store(0, std::memory_order_release);
+        return false;
+    }
+    version.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return true;
+}
+
 Block::Block(const BlockID &id)
     : filename(id.first), offset(id.second), free(true), dirty(false),
-      pinned(false), pos(0) {}
-
-void Block::read(char *dest, size_t size) {
-    std::memcpy(dest, block_data + pos, size);
-    pos += size;
-};
+      pins(0) {}
 
 void Block::readFile() {
     std::ifstream ifs;
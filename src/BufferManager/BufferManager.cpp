@@ -3,16 +3,34 @@
 #include <cstring>
 #include <fstream>
 #include <list>
+#include <mutex>
 #include <sys/stat.h>
+#include <unordered_map>
 
 namespace BM {
 
+struct BlockIDHash {
+    size_t operator()(const BlockID &id) const {
+        return std::hash<std::string>()(id.first) * 31 + id.second;
+    }
+};
+
+// Cached blocks, most recently used first, and where each one is in the
+// list, so that a lookup does not walk it.
 static std::list<PtrBlock> cache;
+static std::unordered_map<BlockID, std::list<PtrBlock>::iterator, BlockIDHash>
+    positions;
+static std::mutex mutex; // guards the cache and the blocks' flags
 static const char empty_buffer[BLOCK_SIZE] = {};
 
-void init() { cache.clear(); }
+void init() {
+    std::lock_guard<std::mutex> lock(mutex);
+    cache.clear();
+    positions.clear();
+}
 
 void exit() {
+    std::lock_guard<std::mutex> lock(mutex);
     for (auto blkPtr : cache) {
         if (blkPtr->isDirty()) {
             blkPtr->writeFile();
@@ -26,23 +44,40 @@ bool fileExists(const std::string &filename) {
     return (stat(filename.c_str(), &buffer) == 0);
 }
 
+// Evicts blocks until there is room for another. The cache grows past its
+// size for as long as every block in it is pinned.
 static void popCache() {
     while (cache.size() >= CACHE_SIZE) {
-        for (auto iter = cache.rbegin(); iter != cache.rend(); ++iter) {
-            auto blkPtr = *iter;
-            if (blkPtr->isPinned()) {
-                continue;
-            } else if (blkPtr->isDirty()) {
-                blkPtr->writeFile();
-                blkPtr->setDirty(false);
-            }
-            cache.erase(std::next(iter).base()); // erase(iter)
-            break;
+        auto iter = cache.rbegin();
+        while (iter != cache.rend() && (*iter)->isPinned()) {
+            ++iter;
+        }
+        if (iter == cache.rend()) {
+            return;
+        }
+        auto blkPtr = *iter;
+        if (blkPtr->isDirty()) {
+            blkPtr->writeFile();
+            blkPtr->setDirty(false);
         }
+        positions.erase(makeID(blkPtr->getFilename(), blkPtr->getOffset()));
+        cache.erase(std::next(iter).base()); // erase(iter)
     }
 }
 
+// Caches a block in place of any other with its ID.
+static void pushCache(const PtrBlock &blkPtr) {
+    auto id = makeID(blkPtr->getFilename(), blkPtr->getOffset());
+    auto pos = positions.find(id);
+    if (pos != positions.end()) {
+        cache.erase(pos->second);
+    }
+    cache.push_front(blkPtr);
+    positions[id] = cache.begin();
+}
+
 void createFile(const std::string &filename, const File::FileType filetype) {
+    std::lock_guard<std::mutex> lock(mutex);
     popCache();
     auto blkPtr = std::make_shared<Block>(makeID(filename, 0));
     blkPtr->setFree(false);
@@ -71,6 +106,7 @@ void createFile(const std::string &filename, const File::FileType filetype) {
         header.beginOffset = 0;
         header.availableOffset = BLOCK_SIZE;
         header.numRecords = 0;
+        header.version = File::TABLE_VERSION;
         write(reinterpret_cast<const char *>(&header), sizeof(header));
         write(empty_buffer, BLOCK_SIZE - sizeof(header));
         break;
@@ -81,47 +117,102 @@ void createFile(const std::string &filename, const File::FileType filetype) {
         header.numBlocks = 1;
         header.rootOffset = 0;
         header.availableOffset = BLOCK_SIZE;
+        header.freeOffset = 0;
+        header.version = File::INDEX_VERSION;
         write(reinterpret_cast<const char *>(&header), sizeof(header));
         write(empty_buffer, BLOCK_SIZE - sizeof(header));
         break;
     }
+    case File::FileType::HASH: {
+        File::hashFileHeader header;
+        header.filetype = static_cast<uint32_t>(filetype);
+        header.numBlocks = 1;
+        header.dirOffset = 0;
+        header.globalDepth = 0;
+        header.freeOffset = 0;
+        write(reinterpret_cast<const char *>(&header), sizeof(header));
+        write(empty_buffer, BLOCK_SIZE - sizeof(header));
+        break;
     }
-    cache.push_front(blkPtr);
+    case File::FileType::LSM: {
+        File::lsmFileHeader header;
+        header.filetype = static_cast<uint32_t>(filetype);
+        header.numBlocks = 1;
+        header.entrySize = 0;
+        header.nextId = 1;
+        header.numRecords = 0;
+        header.nextRun = 0;
+        header.numRuns = 0;
+        header.version = File::LSM_VERSION;
+        write(reinterpret_cast<const char *>(&header), sizeof(header));
+        write(empty_buffer, BLOCK_SIZE - sizeof(header));
+        break;
+    }
+    case File::FileType::RUN:
+    case File::FileType::MEMORY:
+    case File::FileType::BITMAP:
+    case File::FileType::ZONE:
+    case File::FileType::BLOOM: {
+        // written out whole by the record and index managers
+        write(empty_buffer, BLOCK_SIZE);
+        break;
+    }
+    }
+    pushCache(blkPtr);
     blkPtr->createFile();
     blkPtr->setDirty(false);
 }
 
-void deleteFile(const std::string &filename) { std::remove(filename.c_str()); }
-
-PtrBlock readBlock(const BlockID &id) {
-    for (auto iter = cache.begin(); iter != cache.end(); ++iter) {
-        auto blkPtr = *iter;
-        if (blkPtr->getFilename() == id.first &&
-            blkPtr->getOffset() == id.second) {
-            cache.erase(iter);
-            cache.push_front(blkPtr);
-            return blkPtr;
+void deleteFile(const std::string &filename) {
+    // cached blocks must not be written back over a file of the same name
+    std::lock_guard<std::mutex> lock(mutex);
+    cache.remove_if([&](const PtrBlock &blkPtr) -> bool {
+        if (blkPtr->getFilename() != filename) {
+            return false;
         }
+        positions.erase(makeID(filename, blkPtr->getOffset()));
+        return true;
+    });
+    std::remove(filename.c_str());
+}
+
+static PtrBlock fetch(const BlockID &id) {
+    auto pos = positions.find(id);
+    if (pos != positions.end()) {
+        cache.splice(cache.begin(), cache, pos->second);
+        return *pos->second;
     }
     popCache();
     auto blkPtr = std::make_shared<Block>(id);
     blkPtr->readFile();
     blkPtr->setFree(false);
-    cache.push_front(blkPtr);
+    pushCache(blkPtr);
+    return blkPtr;
+}
+
+PtrBlock readBlock(const BlockID &id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return fetch(id);
+}
+
+PtrBlock pinBlock(const BlockID &id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto blkPtr = fetch(id);
+    blkPtr->pin();
     return blkPtr;
 }
 
 void writeBlock(const BlockID &id, const char *src, uint32_t start,
                 size_t size) {
-    for (auto blkPtr : cache) {
-        if (blkPtr->getFilename() == id.first &&
-            blkPtr->getOffset() == id.second) {
-            blkPtr->setDirty(true);
-            std::memcpy(blkPtr->block_data + start, src, size);
-            return;
-        }
+    std::lock_guard<std::mutex> lock(mutex);
+    auto pos = positions.find(id);
+    if (pos != positions.end()) {
+        auto blkPtr = *pos->second;
+        blkPtr->setDirty(true);
+        std::memcpy(blkPtr->block_data + start, src, size);
+        return;
     }
-    auto blkPtr = readBlock(id);
+    auto blkPtr = fetch(id);
     blkPtr->setDirty(true);
     std::memcpy(blkPtr->block_data + start, src, size);
     return;
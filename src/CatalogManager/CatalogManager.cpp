@@ -1,7 +1,9 @@
 #include <BufferManager/Block.h>
 #include <CatalogManager/CatalogManager.h>
 #include <CatalogManager/TableSpec.h>
+#include <IndexManager/Key.h>
 #include <algorithm>
+#include <cstring>
 #include <list>
 #include <memory>
 #include <string>
@@ -16,6 +18,21 @@ std::unordered_map<std::string, Index> mapIndices;
 std::unordered_map<std::string, uint32_t> mapIndexOffsets;
 std::unordered_map<std::string, std::string> mapTableToIndex;
 
+// An index on a single unique attribute has unique keys; the keys of any
+// other index carry the record offset to tell duplicates apart.
+static bool isUniqueKey(const Schema &schema,
+                        const std::vector<std::string> &attrNames) {
+    if (attrNames.size() != 1) {
+        return false;
+    }
+    for (auto &attribute : schema.attributes) {
+        if (attribute.name == attrNames[0]) {
+            return attribute.isUnique;
+        }
+    }
+    return false;
+}
+
 bool hasTable(const std::string &tableName) {
     return mapSchemas.find(tableName) != mapSchemas.end();
 }
@@ -24,6 +41,12 @@ bool hasIndex(const std::string &indexName) {
     return mapIndices.find(indexName) != mapIndices.end();
 }
 
+// Copies bytes of a page at `pos` and moves past them.
+static void readFrom(const char *&pos, char *dest, size_t size) {
+    std::memcpy(dest, pos, size);
+    pos += size;
+}
+
 void init() {
     mapSchemas.clear();
     mapSchemaOffsets.clear();
@@ -37,38 +60,41 @@ void init() {
         BM::createFile(filename, File::FileType::CATALOG);
     }
     BM::PtrBlock blk0 = BM::readBlock(BM::makeID(filename, 0));
-    blk0->resetPos();
     File::catalogFileHeader header;
-    blk0->read(reinterpret_cast<char *>(&header), sizeof(header));
+    std::memcpy(&header, blk0->block_data, sizeof(header));
 
     uint32_t currP = header.tableOffset, nextP = 0;
     static char strbuf[NAME_LENGTH];
 
     while (currP != 0) {
         BM::PtrBlock blk = BM::readBlock(BM::makeID(filename, currP));
-        blk->resetPos();
+        const char *pos = blk->block_data;
         auto schema = std::make_shared<Schema>();
         uint32_t numAttrs = 0;
-        blk->read(reinterpret_cast<char *>(&nextP), sizeof(uint32_t));
+        readFrom(pos, reinterpret_cast<char *>(&nextP), sizeof(uint32_t));
         if (nextP & DELETED_MARK) {
             currP = nextP & DELETED_MASK;
             continue;
         }
-        blk->read(reinterpret_cast<char *>(&numAttrs), sizeof(uint32_t));
-        blk->read(strbuf, NAME_LENGTH);
+        readFrom(pos, reinterpret_cast<char *>(&numAttrs), sizeof(uint32_t));
+        readFrom(pos, strbuf, NAME_LENGTH);
         schema->tableName = std::string(strbuf);
-        blk->read(strbuf, NAME_LENGTH);
+        readFrom(pos, strbuf, NAME_LENGTH);
         schema->primaryKey = std::string(strbuf);
         for (auto i = 0u; i != numAttrs; ++i) {
             Attribute attribute;
-            blk->read(strbuf, NAME_LENGTH);
+            readFrom(pos, strbuf, NAME_LENGTH);
             attribute.name = std::string(strbuf);
             uint32_t bin;
-            blk->read(reinterpret_cast<char *>(&bin), sizeof(uint32_t));
+            readFrom(pos, reinterpret_cast<char *>(&bin), sizeof(uint32_t));
             std::tie(attribute.type, attribute.charCnt, attribute.isUnique) =
                 decodeProperties(bin);
             schema->attributes.push_back(attribute);
         }
+        // records of older catalogs end with the attributes
+        uint32_t engine = 0;
+        readFrom(pos, reinterpret_cast<char *>(&engine), sizeof(uint32_t));
+        schema->engine = static_cast<TableEngine>(engine);
         mapSchemas[schema->tableName] = schema;
         mapSchemaOffsets[schema->tableName] = currP;
         currP = nextP;
@@ -78,29 +104,50 @@ void init() {
     nextP = 0;
     while (currP != 0) {
         BM::PtrBlock blk = BM::readBlock(BM::makeID(filename, currP));
-        blk->resetPos();
-        blk->read(reinterpret_cast<char *>(&nextP), sizeof(uint32_t));
+        const char *pos = blk->block_data;
+        readFrom(pos, reinterpret_cast<char *>(&nextP), sizeof(uint32_t));
         if (nextP & DELETED_MARK) {
             currP = nextP & DELETED_MASK;
             continue;
         }
         Index index;
-        blk->read(strbuf, NAME_LENGTH);
+        readFrom(pos, strbuf, NAME_LENGTH);
         index.indexName = std::string(strbuf);
-        blk->read(strbuf, NAME_LENGTH);
+        readFrom(pos, strbuf, NAME_LENGTH);
         index.tableName = std::string(strbuf);
-        blk->read(strbuf, NAME_LENGTH);
-        index.attrName = std::string(strbuf);
+        readFrom(pos, strbuf, NAME_LENGTH);
+        index.attrNames.push_back(std::string(strbuf));
+        // attributes after the first; records of older catalogs have none
+        uint32_t numAttrs = 0;
+        readFrom(pos, reinterpret_cast<char *>(&numAttrs), sizeof(uint32_t));
+        for (auto i = 1u; i < numAttrs; ++i) {
+            readFrom(pos, strbuf, NAME_LENGTH);
+            index.attrNames.push_back(std::string(strbuf));
+        }
+        uint32_t type = 0;
+        readFrom(pos, reinterpret_cast<char *>(&type), sizeof(uint32_t));
+        index.type = static_cast<IndexType>(type);
+        uint32_t numIncludes = 0;
+        readFrom(pos, reinterpret_cast<char *>(&numIncludes), sizeof(uint32_t));
+        for (auto i = 0u; i < numIncludes; ++i) {
+            readFrom(pos, strbuf, NAME_LENGTH);
+            index.includeNames.push_back(std::string(strbuf));
+        }
+        index.isUnique =
+            isUniqueKey(*mapSchemas.at(index.tableName), index.attrNames);
         mapIndices[index.indexName] = index;
         mapIndexOffsets[index.indexName] = currP;
-        mapTableToIndex[index.attrName + "@" + index.tableName] =
-            index.indexName;
+        if (index.attrNames.size() == 1) {
+            mapTableToIndex[index.attrNames[0] + "@" + index.tableName] =
+                index.indexName;
+        }
         currP = nextP;
     }
 }
 
 void createTable(const std::string &tableName, const std::string &primaryKey,
-                 const std::vector<Attribute> &_attributes) {
+                 const std::vector<Attribute> &_attributes,
+                 const TableEngine engine) {
     if (hasTable(tableName)) {
         throw SQLError("table \'" + tableName + "\' already exists");
     }
@@ -121,13 +168,13 @@ void createTable(const std::string &tableName, const std::string &primaryKey,
     schema->tableName = tableName;
     schema->primaryKey = primaryKey;
     schema->attributes = attributes;
+    schema->engine = engine;
     mapSchemas[tableName] = schema;
 
     auto filename = File::catalogFilename();
     BM::PtrBlock blk0 = BM::readBlock(BM::makeID(filename, 0));
     File::catalogFileHeader header;
-    blk0->resetPos();
-    blk0->read(reinterpret_cast<char *>(&header), sizeof(header));
+    std::memcpy(&header, blk0->block_data, sizeof(header));
 
     uint32_t newP = header.numBlocks++;
     uint32_t nextP = header.tableOffset;
@@ -165,6 +212,8 @@ void createTable(const std::string &tableName, const std::string &primaryKey,
         writeP(strbuf, NAME_LENGTH);
         writeP(reinterpret_cast<const char *>(&bin), sizeof(uint32_t));
     }
+    uint32_t bin = static_cast<uint32_t>(engine);
+    writeP(reinterpret_cast<const char *>(&bin), sizeof(uint32_t));
 }
 
 void dropTable(const std::string &tableName) {
@@ -175,8 +224,7 @@ void dropTable(const std::string &tableName) {
     uint32_t offset = mapSchemaOffsets[tableName], nextP;
 
     BM::PtrBlock blk = BM::readBlock(BM::makeID(filename, offset));
-    blk->resetPos(0);
-    blk->read(reinterpret_cast<char *>(&nextP), sizeof(uint32_t));
+    std::memcpy(&nextP, blk->block_data, sizeof(uint32_t));
     nextP |= DELETED_MARK;
     BM::writeBlock(BM::makeID(filename, offset),
                    reinterpret_cast<const char *>(&nextP), 0, sizeof(uint32_t));
@@ -185,35 +233,71 @@ void dropTable(const std::string &tableName) {
 }
 
 void createIndex(const std::string &indexName, const std::string &tableName,
-                 const std::string &attrName) {
+                 const std::vector<std::string> &attrNames,
+                 const IndexType type,
+                 const std::vector<std::string> &includeNames) {
     if (hasIndex(indexName)) {
         throw SQLError("index \'" + indexName + "\' already exists");
     }
     if (!hasTable(tableName)) {
         throw SQLError("table \'" + tableName + "\' does not exist");
     }
+    // only the leaves of a B+tree have room for included attributes
+    if (!includeNames.empty() && type != IndexType::BTREE &&
+        type != IndexType::BUFFERED) {
+        const char *kind = type == IndexType::HASH  ? "hash"
+                           : type == IndexType::ART ? "art"
+                                                    : "bitmap";
+        throw SQLError(std::string(kind) + " index '" + indexName +
+                       "' cannot include attributes");
+    }
     auto schema = mapSchemas[tableName];
     auto &attributes = schema->attributes;
-    if (std::none_of(attributes.begin(), attributes.end(),
-                     [&](const Attribute &attribute) -> bool {
-                         return attribute.name == attrName;
-                     })) {
-        throw SQLError("cannot find attribute \'" + attrName +
-                       "\' in table \'" + tableName + "\'");
+    // included attributes are stored after the key, so they count towards
+    // its length
+    std::vector<std::string> columns(attrNames);
+    columns.insert(columns.end(), includeNames.begin(), includeNames.end());
+    size_t keyLength = 0;
+    for (auto iter = columns.begin(); iter != columns.end(); ++iter) {
+        auto &attrName = *iter;
+        auto attribute = std::find_if(attributes.begin(), attributes.end(),
+                                      [&](const Attribute &attribute) -> bool {
+                                          return attribute.name == attrName;
+                                      });
+        if (attribute == attributes.end()) {
+            throw SQLError("cannot find attribute \'" + attrName +
+                           "\' in table \'" + tableName + "\'");
+        }
+        if (std::find(columns.begin(), iter, attrName) != iter) {
+            throw SQLError("duplicate attribute \'" + attrName +
+                           "\' in index \'" + indexName + "\'");
+        }
+        keyLength += IM::encodedWidth(attribute->type, attribute->charCnt);
+    }
+    bool isUnique = isUniqueKey(*schema, attrNames);
+    if (!isUnique) {
+        keyLength += sizeof(uint32_t);
+    }
+    if (keyLength > KEY_LENGTH) {
+        throw SQLError("key of index \'" + indexName + "\' is too long");
     }
 
     Index index;
     index.indexName = indexName;
     index.tableName = tableName;
-    index.attrName = attrName;
+    index.attrNames = attrNames;
+    index.includeNames = includeNames;
+    index.type = type;
+    index.isUnique = isUnique;
     mapIndices[indexName] = index;
-    mapTableToIndex[attrName + "@" + tableName] = indexName;
+    if (attrNames.size() == 1) {
+        mapTableToIndex[attrNames[0] + "@" + tableName] = indexName;
+    }
 
     auto filename = File::catalogFilename();
     BM::PtrBlock blk0 = BM::readBlock(BM::makeID(filename, 0));
     File::catalogFileHeader header;
-    blk0->resetPos();
-    blk0->read(reinterpret_cast<char *>(&header), sizeof(header));
+    std::memcpy(&header, blk0->block_data, sizeof(header));
 
     uint32_t newP = header.numBlocks++;
     uint32_t nextP = header.indexOffset;
@@ -243,8 +327,25 @@ void createIndex(const std::string &indexName, const std::string &tableName,
     writeP(strbuf, NAME_LENGTH);
 
     memset(strbuf, 0, NAME_LENGTH);
-    std::strcpy(strbuf, attrName.c_str());
+    std::strcpy(strbuf, attrNames[0].c_str());
     writeP(strbuf, NAME_LENGTH);
+
+    uint32_t numAttrs = attrNames.size();
+    writeP(reinterpret_cast<const char *>(&numAttrs), sizeof(uint32_t));
+    for (auto i = 1u; i < numAttrs; ++i) {
+        memset(strbuf, 0, NAME_LENGTH);
+        std::strcpy(strbuf, attrNames[i].c_str());
+        writeP(strbuf, NAME_LENGTH);
+    }
+    uint32_t bin = static_cast<uint32_t>(type);
+    writeP(reinterpret_cast<const char *>(&bin), sizeof(uint32_t));
+    uint32_t numIncludes = includeNames.size();
+    writeP(reinterpret_cast<const char *>(&numIncludes), sizeof(uint32_t));
+    for (auto &includeName : includeNames) {
+        memset(strbuf, 0, NAME_LENGTH);
+        std::strcpy(strbuf, includeName.c_str());
+        writeP(strbuf, NAME_LENGTH);
+    }
 }
 
 void dropIndex(const std::string &indexName) {
@@ -255,15 +356,24 @@ void dropIndex(const std::string &indexName) {
     uint32_t offset = mapIndexOffsets[indexName], nextP;
 
     BM::PtrBlock blk = BM::readBlock(BM::makeID(filename, offset));
-    blk->resetPos(0);
-    blk->read(reinterpret_cast<char *>(&nextP), sizeof(uint32_t));
+    std::memcpy(&nextP, blk->block_data, sizeof(uint32_t));
     nextP |= DELETED_MARK;
     BM::writeBlock(BM::makeID(filename, offset),
                    reinterpret_cast<const char *>(&nextP), 0, sizeof(uint32_t));
     Index index = mapIndices[indexName];
-    mapTableToIndex.erase(index.attrName + "@" + index.tableName);
     mapIndices.erase(indexName);
     mapIndexOffsets.erase(indexName);
+    auto key = index.attrNames[0] + "@" + index.tableName;
+    if (index.attrNames.size() == 1 && mapTableToIndex[key] == indexName) {
+        mapTableToIndex.erase(key);
+        // another index on the same attribute takes over
+        for (auto &other : mapIndices) {
+            if (other.second.tableName == index.tableName &&
+                other.second.attrNames == index.attrNames) {
+                mapTableToIndex[key] = other.first;
+            }
+        }
+    }
 }
 
 void checkPredicates(const std::string &tableName,
@@ -299,6 +409,16 @@ std::string hasIndex(const std::string &tableName,
     }
 }
 
+std::vector<Index> getIndices(const std::string &tableName) {
+    std::vector<Index> indices;
+    for (auto &index : mapIndices) {
+        if (index.second.tableName == tableName) {
+            indices.push_back(index.second);
+        }
+    }
+    return indices;
+}
+
 void exit() {}
 
 std::shared_ptr<Schema> getSchema(const std::string &tableName) {
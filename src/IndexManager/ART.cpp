@@ -0,0 +1,718 @@
+#include <Error.h>
+#include <IndexManager/ART.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <new>
+
+namespace IM {
+
+namespace ART {
+
+enum NodeType : uint8_t { LEAF, NODE4, NODE16, NODE48, NODE256 };
+
+// Header of the inner nodes; a leaf shares only the type.
+struct Node {
+    uint8_t type;
+    uint16_t numChildren;
+    uint32_t prefixLen; // bytes shared below, of which MAX_PREFIX are stored
+    unsigned char prefix[MAX_PREFIX];
+};
+
+struct Leaf {
+    uint8_t type;
+    uint32_t length;
+    Off offset;
+    unsigned char key[1]; // `length` bytes
+};
+
+// Nodes of 4 and 16 children, with the bytes leading to them in order.
+template <uint8_t Type, size_t N> struct Sorted {
+    static constexpr uint8_t TYPE = Type;
+    static constexpr size_t CAPACITY = N;
+    Node header;
+    unsigned char keys[N];
+    Node *children[N];
+};
+
+using Node4 = Sorted<NODE4, 4>;
+using Node16 = Sorted<NODE16, 16>;
+
+struct Node48 {
+    static constexpr uint8_t TYPE = NODE48;
+    Node header;
+    unsigned char index[256]; // 1 + position of the child of a byte, or 0
+    Node *children[48];
+};
+
+struct Node256 {
+    static constexpr uint8_t TYPE = NODE256;
+    Node header;
+    Node *children[256];
+};
+
+static bool isLeaf(const Node *n) { return n->type == LEAF; }
+
+static Leaf *asLeaf(Node *n) { return reinterpret_cast<Leaf *>(n); }
+
+static const Leaf *asLeaf(const Node *n) {
+    return reinterpret_cast<const Leaf *>(n);
+}
+
+template <typename T> static T *as(Node *n) {
+    return reinterpret_cast<T *>(n);
+}
+
+template <typename T> static const T *as(const Node *n) {
+    return reinterpret_cast<const T *>(n);
+}
+
+static unsigned char byteAt(const Key &key, size_t depth) {
+    return static_cast<unsigned char>(key[depth]);
+}
+
+static size_t leafSize(size_t length) { return offsetof(Leaf, key) + length; }
+
+static size_t nodeSize(const Node *n) {
+    switch (n->type) {
+    case LEAF:
+        return leafSize(asLeaf(n)->length);
+    case NODE4:
+        return sizeof(Node4);
+    case NODE16:
+        return sizeof(Node16);
+    case NODE48:
+        return sizeof(Node48);
+    default:
+        return sizeof(Node256);
+    }
+}
+
+static bool matches(const Leaf *leaf, const Key &key) {
+    return leaf->length == key.size() &&
+           std::memcmp(leaf->key, key.data(), key.size()) == 0;
+}
+
+// Where the child of a byte is kept, or nullptr if there is none.
+static Node **slot(Node *n, unsigned char c) {
+    switch (n->type) {
+    case NODE4: {
+        auto node = as<Node4>(n);
+        for (int i = 0; i < n->numChildren; i++) {
+            if (node->keys[i] == c) {
+                return &node->children[i];
+            }
+        }
+        return nullptr;
+    }
+    case NODE16: {
+        auto node = as<Node16>(n);
+        auto end = node->keys + n->numChildren;
+        auto iter = std::lower_bound(node->keys, end, c);
+        return iter != end && *iter == c
+                   ? &node->children[iter - node->keys]
+                   : nullptr;
+    }
+    case NODE48: {
+        auto node = as<Node48>(n);
+        int pos = node->index[c];
+        return pos != 0 ? &node->children[pos - 1] : nullptr;
+    }
+    default: {
+        auto node = as<Node256>(n);
+        return node->children[c] != nullptr ? &node->children[c] : nullptr;
+    }
+    }
+}
+
+static const Node *child(const Node *n, unsigned char c) {
+    Node **ptr = slot(const_cast<Node *>(n), c);
+    return ptr != nullptr ? *ptr : nullptr;
+}
+
+// Visits the children of a node along with their bytes, in the order of
+// the bytes and from the byte given, until `visit` returns false.
+template <typename F>
+static bool eachChild(const Node *n, F visit, unsigned char from = 0) {
+    switch (n->type) {
+    case NODE4: {
+        auto node = as<Node4>(n);
+        for (int i = 0; i < n->numChildren; i++) {
+            if (node->keys[i] >= from &&
+                !visit(node->keys[i], node->children[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+    case NODE16: {
+        auto node = as<Node16>(n);
+        auto end = node->keys + n->numChildren;
+        for (int i = std::lower_bound(node->keys, end, from) - node->keys;
+             i < n->numChildren; i++) {
+            if (!visit(node->keys[i], node->children[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+    case NODE48: {
+        auto node = as<Node48>(n);
+        for (int c = from; c < 256; c++) {
+            int pos = node->index[c];
+            auto byte = static_cast<unsigned char>(c);
+            if (pos != 0 && !visit(byte, node->children[pos - 1])) {
+                return false;
+            }
+        }
+        return true;
+    }
+    default: {
+        auto node = as<Node256>(n);
+        for (int c = from; c < 256; c++) {
+            if (node->children[c] != nullptr &&
+                !visit(static_cast<unsigned char>(c), node->children[c])) {
+                return false;
+            }
+        }
+        return true;
+    }
+    }
+}
+
+// The leaf of the smallest key below a node, which holds the bytes of its
+// prefix past those stored.
+static const Leaf *minimum(const Node *n) {
+    while (!isLeaf(n)) {
+        const Node *first = nullptr;
+        eachChild(n, [&](unsigned char, const Node *child) {
+            first = child;
+            return false;
+        });
+        n = first;
+    }
+    return asLeaf(n);
+}
+
+// Whether a key agrees with the stored bytes of a node's prefix and goes
+// on past it. The bytes that are not stored are checked at the leaf.
+static bool prefixMatches(const Node *n, const Key &key, size_t depth) {
+    if (depth + n->prefixLen >= key.size()) {
+        return false;
+    }
+    size_t len = std::min<size_t>(n->prefixLen, MAX_PREFIX);
+    return std::memcmp(n->prefix, key.data() + depth, len) == 0;
+}
+
+// Number of bytes of a node's prefix that a key agrees with.
+static size_t mismatch(const Node *n, const Key &key, size_t depth) {
+    size_t limit = std::min<size_t>(n->prefixLen, key.size() - depth);
+    size_t i = 0;
+    for (size_t stored = std::min<size_t>(limit, MAX_PREFIX); i < stored;
+         i++) {
+        if (n->prefix[i] != byteAt(key, depth + i)) {
+            return i;
+        }
+    }
+    if (i < limit) {
+        auto leaf = minimum(n);
+        for (; i < limit; i++) {
+            if (leaf->key[depth + i] != byteAt(key, depth + i)) {
+                return i;
+            }
+        }
+    }
+    return i;
+}
+
+static void copyHeader(Node *dest, const Node *src) {
+    dest->numChildren = src->numChildren;
+    dest->prefixLen = src->prefixLen;
+    std::memcpy(dest->prefix, src->prefix, MAX_PREFIX);
+}
+
+template <typename T> static void addSorted(T *node, unsigned char c,
+                                            Node *child) {
+    int num = node->header.numChildren;
+    int i = std::lower_bound(node->keys, node->keys + num, c) - node->keys;
+    std::memmove(node->keys + i + 1, node->keys + i, num - i);
+    std::memmove(node->children + i + 1, node->children + i,
+                 (num - i) * sizeof(Node *));
+    node->keys[i] = c;
+    node->children[i] = child;
+    node->header.numChildren++;
+}
+
+static void add48(Node48 *node, unsigned char c, Node *child) {
+    int pos = 0;
+    while (node->children[pos] != nullptr) {
+        pos++;
+    }
+    node->index[c] = static_cast<unsigned char>(pos + 1);
+    node->children[pos] = child;
+    node->header.numChildren++;
+}
+
+static void violation() {
+    throw SysError("key of an index is a prefix of another");
+}
+
+Leaf *Tree::makeLeaf(const Key &key, Off offset) {
+    size_t size = leafSize(key.size());
+    auto leaf = static_cast<Leaf *>(::operator new(size));
+    leaf->type = LEAF;
+    leaf->length = static_cast<uint32_t>(key.size());
+    leaf->offset = offset;
+    std::memcpy(leaf->key, key.data(), key.size());
+    numBytes += size;
+    return leaf;
+}
+
+template <typename T> T *Tree::makeNode() {
+    T *node = new T();
+    node->header.type = T::TYPE;
+    numBytes += sizeof(T);
+    return node;
+}
+
+void Tree::release(Node *n) {
+    numBytes -= nodeSize(n);
+    switch (n->type) {
+    case LEAF:
+        ::operator delete(n);
+        break;
+    case NODE4:
+        delete as<Node4>(n);
+        break;
+    case NODE16:
+        delete as<Node16>(n);
+        break;
+    case NODE48:
+        delete as<Node48>(n);
+        break;
+    default:
+        delete as<Node256>(n);
+        break;
+    }
+}
+
+void Tree::destroy(Node *n) {
+    if (!isLeaf(n)) {
+        eachChild(n, [&](unsigned char, const Node *child) {
+            destroy(const_cast<Node *>(child));
+            return true;
+        });
+    }
+    release(n);
+}
+
+void Tree::clear() {
+    if (root != nullptr) {
+        destroy(root);
+        root = nullptr;
+    }
+    numEntries = 0;
+}
+
+bool Tree::find(const Key &key, Off &offset) const {
+    const Node *n = root;
+    size_t depth = 0;
+    while (n != nullptr) {
+        if (isLeaf(n)) {
+            auto leaf = asLeaf(n);
+            if (!matches(leaf, key)) {
+                return false;
+            }
+            offset = leaf->offset;
+            return true;
+        }
+        if (!prefixMatches(n, key, depth)) {
+            return false;
+        }
+        depth += n->prefixLen;
+        n = child(n, byteAt(key, depth++));
+    }
+    return false;
+}
+
+// Adds a child under a byte the node has none for, growing the node into
+// the next size when it is full.
+void Tree::addChild(Node *&ref, unsigned char c, Node *child) {
+    Node *n = ref;
+    switch (n->type) {
+    case NODE4: {
+        if (n->numChildren < Node4::CAPACITY) {
+            addSorted(as<Node4>(n), c, child);
+            return;
+        }
+        auto node = makeNode<Node16>();
+        copyHeader(&node->header, n);
+        std::memcpy(node->keys, as<Node4>(n)->keys, Node4::CAPACITY);
+        std::memcpy(node->children, as<Node4>(n)->children,
+                    sizeof(as<Node4>(n)->children));
+        addSorted(node, c, child);
+        ref = &node->header;
+        break;
+    }
+    case NODE16: {
+        if (n->numChildren < Node16::CAPACITY) {
+            addSorted(as<Node16>(n), c, child);
+            return;
+        }
+        auto node = makeNode<Node48>();
+        copyHeader(&node->header, n);
+        for (int i = 0; i < n->numChildren; i++) {
+            node->index[as<Node16>(n)->keys[i]] =
+                static_cast<unsigned char>(i + 1);
+            node->children[i] = as<Node16>(n)->children[i];
+        }
+        add48(node, c, child);
+        ref = &node->header;
+        break;
+    }
+    case NODE48: {
+        if (n->numChildren < 48) {
+            add48(as<Node48>(n), c, child);
+            return;
+        }
+        auto node = makeNode<Node256>();
+        copyHeader(&node->header, n);
+        for (int b = 0; b < 256; b++) {
+            int pos = as<Node48>(n)->index[b];
+            if (pos != 0) {
+                node->children[b] = as<Node48>(n)->children[pos - 1];
+            }
+        }
+        node->children[c] = child;
+        node->header.numChildren++;
+        ref = &node->header;
+        break;
+    }
+    default:
+        as<Node256>(n)->children[c] = child;
+        n->numChildren++;
+        return;
+    }
+    release(n);
+}
+
+bool Tree::insert(const Key &key, Off offset) {
+    if (insert(root, key, offset, 0)) {
+        numEntries++;
+        return true;
+    }
+    return false;
+}
+
+bool Tree::insert(Node *&ref, const Key &key, Off offset, size_t depth) {
+    Node *n = ref;
+    if (n == nullptr) {
+        ref = reinterpret_cast<Node *>(makeLeaf(key, offset));
+        return true;
+    }
+    if (isLeaf(n)) {
+        auto leaf = asLeaf(n);
+        if (matches(leaf, key)) {
+            leaf->offset = offset;
+            return false;
+        }
+        // both keys go below a node for the bytes they share
+        size_t len = depth;
+        size_t limit = std::min<size_t>(leaf->length, key.size());
+        while (len < limit && leaf->key[len] == byteAt(key, len)) {
+            len++;
+        }
+        if (len == limit) {
+            violation();
+        }
+        auto node = makeNode<Node4>();
+        node->header.prefixLen = static_cast<uint32_t>(len - depth);
+        std::memcpy(node->header.prefix, key.data() + depth,
+                    std::min<size_t>(len - depth, MAX_PREFIX));
+        ref = &node->header;
+        addChild(ref, leaf->key[len], n);
+        addChild(ref, byteAt(key, len),
+                 reinterpret_cast<Node *>(makeLeaf(key, offset)));
+        return true;
+    }
+    if (n->prefixLen > 0) {
+        size_t diff = mismatch(n, key, depth);
+        if (diff < n->prefixLen) {
+            // the key leaves the prefix: split it where it does
+            if (depth + diff >= key.size()) {
+                violation();
+            }
+            auto node = makeNode<Node4>();
+            node->header.prefixLen = static_cast<uint32_t>(diff);
+            std::memcpy(node->header.prefix, n->prefix,
+                        std::min<size_t>(diff, MAX_PREFIX));
+            ref = &node->header;
+            if (n->prefixLen <= MAX_PREFIX) {
+                addChild(ref, n->prefix[diff], n);
+                n->prefixLen -= diff + 1;
+                std::memmove(n->prefix, n->prefix + diff + 1,
+                             std::min<size_t>(n->prefixLen, MAX_PREFIX));
+            } else {
+                auto leaf = minimum(n);
+                addChild(ref, leaf->key[depth + diff], n);
+                n->prefixLen -= diff + 1;
+                std::memcpy(n->prefix, leaf->key + depth + diff + 1,
+                            std::min<size_t>(n->prefixLen, MAX_PREFIX));
+            }
+            addChild(ref, byteAt(key, depth + diff),
+                     reinterpret_cast<Node *>(makeLeaf(key, offset)));
+            return true;
+        }
+        depth += n->prefixLen;
+    }
+    if (depth >= key.size()) {
+        violation();
+    }
+    Node **next = slot(n, byteAt(key, depth));
+    if (next != nullptr) {
+        return insert(*next, key, offset, depth + 1);
+    }
+    addChild(ref, byteAt(key, depth),
+             reinterpret_cast<Node *>(makeLeaf(key, offset)));
+    return true;
+}
+
+// Takes away the child under a byte, shrinking the node into the next
+// size when it gets sparse. A node left with a single child gives way to
+// it.
+void Tree::removeChild(Node *&ref, unsigned char c) {
+    Node *n = ref;
+    switch (n->type) {
+    case NODE4:
+    case NODE16: {
+        unsigned char *keys;
+        Node **children;
+        if (n->type == NODE4) {
+            keys = as<Node4>(n)->keys;
+            children = as<Node4>(n)->children;
+        } else {
+            keys = as<Node16>(n)->keys;
+            children = as<Node16>(n)->children;
+        }
+        int num = n->numChildren;
+        int i = std::lower_bound(keys, keys + num, c) - keys;
+        std::memmove(keys + i, keys + i + 1, num - i - 1);
+        std::memmove(children + i, children + i + 1,
+                     (num - i - 1) * sizeof(Node *));
+        n->numChildren--;
+        if (n->type == NODE16 && n->numChildren == 3) {
+            auto node = makeNode<Node4>();
+            copyHeader(&node->header, n);
+            std::memcpy(node->keys, keys, 3);
+            std::memcpy(node->children, children, 3 * sizeof(Node *));
+            ref = &node->header;
+            release(n);
+        } else if (n->type == NODE4 && n->numChildren == 1) {
+            Node *only = children[0];
+            if (!isLeaf(only)) {
+                // the child takes the prefix, then the byte leading to it,
+                // in front of its own
+                unsigned char prefix[MAX_PREFIX];
+                size_t len = std::min<size_t>(n->prefixLen, MAX_PREFIX);
+                std::memcpy(prefix, n->prefix, len);
+                if (len < MAX_PREFIX) {
+                    prefix[len++] = keys[0];
+                }
+                if (len < MAX_PREFIX) {
+                    size_t more = std::min<size_t>(
+                        std::min<size_t>(only->prefixLen, MAX_PREFIX),
+                        MAX_PREFIX - len);
+                    std::memcpy(prefix + len, only->prefix, more);
+                    len += more;
+                }
+                std::memcpy(only->prefix, prefix, len);
+                only->prefixLen += n->prefixLen + 1;
+            }
+            ref = only;
+            release(n);
+        }
+        return;
+    }
+    case NODE48: {
+        auto node = as<Node48>(n);
+        node->children[node->index[c] - 1] = nullptr;
+        node->index[c] = 0;
+        n->numChildren--;
+        if (n->numChildren == 12) {
+            auto small = makeNode<Node16>();
+            copyHeader(&small->header, n);
+            int i = 0;
+            for (int b = 0; b < 256; b++) {
+                int pos = node->index[b];
+                if (pos != 0) {
+                    small->keys[i] = static_cast<unsigned char>(b);
+                    small->children[i++] = node->children[pos - 1];
+                }
+            }
+            ref = &small->header;
+            release(n);
+        }
+        return;
+    }
+    default: {
+        auto node = as<Node256>(n);
+        node->children[c] = nullptr;
+        n->numChildren--;
+        if (n->numChildren == 37) {
+            auto small = makeNode<Node48>();
+            copyHeader(&small->header, n);
+            int pos = 0;
+            for (int b = 0; b < 256; b++) {
+                if (node->children[b] != nullptr) {
+                    small->children[pos++] = node->children[b];
+                    small->index[b] = static_cast<unsigned char>(pos);
+                }
+            }
+            ref = &small->header;
+            release(n);
+        }
+        return;
+    }
+    }
+}
+
+bool Tree::remove(const Key &key) {
+    if (remove(root, key, 0)) {
+        numEntries--;
+        return true;
+    }
+    return false;
+}
+
+bool Tree::remove(Node *&ref, const Key &key, size_t depth) {
+    Node *n = ref;
+    if (n == nullptr) {
+        return false;
+    }
+    if (isLeaf(n)) {
+        if (!matches(asLeaf(n), key)) {
+            return false;
+        }
+        ref = nullptr;
+        release(n);
+        return true;
+    }
+    if (!prefixMatches(n, key, depth)) {
+        return false;
+    }
+    depth += n->prefixLen;
+    Node **next = slot(n, byteAt(key, depth));
+    if (next == nullptr || !remove(*next, key, depth + 1)) {
+        return false;
+    }
+    if (*next == nullptr) {
+        removeChild(ref, byteAt(key, depth));
+    }
+    return true;
+}
+
+struct Range {
+    const Key *lo, *hi;
+    bool loInclusive, hiInclusive;
+    const std::function<bool(Off)> &visit;
+};
+
+// Compares the keys below a node to a bound they agree with up to
+// `depth`, by the `len` bytes they share from there, truncated to the
+// bound. Returns -1 or 1 if they all fall below or above it, 2 if they
+// all start with it, and 0 if the bytes run out first.
+static int side(const unsigned char *bytes, size_t len, const Key &bound,
+                size_t depth) {
+    size_t num = std::min(len, bound.size() - depth);
+    int result = std::memcmp(bytes, bound.data() + depth, num);
+    if (result != 0) {
+        return result < 0 ? -1 : 1;
+    }
+    return num == bound.size() - depth ? 2 : 0;
+}
+
+// Visits the keys below a node in order, given that they agree with the
+// bounds still to be checked up to `depth`. Bounds are only compared on
+// the way down the edges of the range; the subtrees between them are
+// taken whole. Returns false once past the upper bound.
+static bool walk(const Node *n, size_t depth, bool checkLo, bool checkHi,
+                 const Range &range) {
+    if (checkLo || checkHi) {
+        const unsigned char *bytes;
+        size_t len;
+        if (isLeaf(n)) {
+            bytes = asLeaf(n)->key + depth;
+            len = asLeaf(n)->length - depth;
+        } else if (n->prefixLen <= MAX_PREFIX) {
+            bytes = n->prefix;
+            len = n->prefixLen;
+        } else {
+            bytes = minimum(n)->key + depth;
+            len = n->prefixLen;
+        }
+        if (checkLo) {
+            int result = side(bytes, len, *range.lo, depth);
+            // a whole key shorter than the bound sorts below it
+            if (result == 0 && isLeaf(n)) {
+                result = -1;
+            }
+            if (result < 0 || (result == 2 && !range.loInclusive)) {
+                return true;
+            }
+            checkLo = result == 0;
+        }
+        if (checkHi) {
+            int result = side(bytes, len, *range.hi, depth);
+            if (result == 1 || (result == 2 && !range.hiInclusive)) {
+                return false;
+            }
+            checkHi = result == 0 && !isLeaf(n);
+        }
+    }
+    if (isLeaf(n)) {
+        return range.visit(asLeaf(n)->offset);
+    }
+    depth += n->prefixLen;
+    // children are told apart by their byte at `depth`, which the bounds
+    // still checked have
+    int lo = checkLo ? byteAt(*range.lo, depth) : -1;
+    int hi = checkHi ? byteAt(*range.hi, depth) : 256;
+    bool more = true;
+    eachChild(n, [&](unsigned char c, const Node *child) {
+        if (c > hi) {
+            more = false;
+            return false;
+        }
+        bool nextLo = c == lo, nextHi = c == hi;
+        if (nextLo && depth + 1 == range.lo->size()) {
+            if (!range.loInclusive) {
+                return true;
+            }
+            nextLo = false;
+        }
+        if (nextHi && depth + 1 == range.hi->size()) {
+            if (!range.hiInclusive) {
+                more = false;
+                return false;
+            }
+            nextHi = false;
+        }
+        more = walk(child, depth + 1, nextLo, nextHi, range);
+        return more;
+    }, static_cast<unsigned char>(std::max(lo, 0)));
+    return more;
+}
+
+void Tree::scan(const Key *lo, bool loInclusive, const Key *hi,
+                bool hiInclusive,
+                const std::function<bool(Off)> &visit) const {
+    if (root == nullptr) {
+        return;
+    }
+    Range range{lo, hi, loInclusive, hiInclusive, visit};
+    walk(root, 0, lo != nullptr, hi != nullptr, range);
+}
+
+} // namespace ART
+
+} // namespace IM
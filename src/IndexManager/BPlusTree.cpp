@@ -1,311 +1,1423 @@
 #include <BufferManager/BufferManager.h>
 #include <IndexManager/BPlusTree.h>
+#include <Error.h>
 #include <algorithm>
+#include <cstring>
+#include <limits>
 #include <memory>
 
 namespace IM {
 
 namespace BPlusTree {
 
-Node::Node(int fanout) : parent(NullPtr), numKeys(0), isLeaf(false) {
-    keys = new Key[fanout - 1];
-    children = new Ptr[fanout];
-    std::fill_n(children, fanout, NullPtr);
+// Node page layouts. Both start with the key count, the leaf flag and the
+// leaf sibling as uint32_t. A prefix-compressed node goes on with the
+// length of the prefix shared by every key of the node as uint16_t, the
+// prefix itself, the children, one uint16_t end position per key, and
+// finally the keys with the prefix cut off. A packed node leaves a word
+// unused, so that its keys start on eight bytes, and goes on with the keys
+// as integers in the byte order of the machine, then the children.
+constexpr size_t HEADER_SIZE = 3 * sizeof(uint32_t) + sizeof(uint16_t);
+constexpr size_t PACKED_HEADER_SIZE = 4 * sizeof(uint32_t);
+
+static size_t commonPrefix(const Key &lhs, const Key &rhs) {
+    size_t len = std::min(lhs.size(), rhs.size()), i = 0;
+    while (i < len && lhs[i] == rhs[i]) {
+        i++;
+    }
+    return i;
 }
 
-Node::~Node() {
-    delete[] keys;
-    delete[] children;
+// Size of a node encoding given its shape and the summed length of its
+// keys before prefix compression.
+static size_t encodedSize(size_t numChildren, size_t numKeys,
+                          size_t prefixLen, size_t sumLen) {
+    size_t size = HEADER_SIZE + numChildren * sizeof(Ptr) + sumLen;
+    if (numKeys > 0) {
+        size += prefixLen + numKeys * sizeof(uint16_t);
+        size -= numKeys * prefixLen;
+    }
+    return size;
 }
 
-bool Node::isRoot() { return parent == NullPtr; }
+static size_t packedSize(size_t numChildren, size_t numKeys, size_t width) {
+    return PACKED_HEADER_SIZE + numKeys * width + numChildren * sizeof(Ptr);
+}
 
-void Node::readFromBlock(BM::PtrBlock blk,
-                         const std::pair<ValueType, size_t> &info) {
-    Ptr ptr;
-    Value value;
-    uint32_t isLeafCnt;
+// Shortest key that sorts after `lhs` and no later than `rhs`, so that
+// separators between leaves carry no more of a key than they need. Packed
+// nodes pad it with zero bytes to their width, which still sorts it
+// between the two.
+static Key separator(const Key &lhs, const Key &rhs, size_t width) {
+    Key key = rhs.substr(0, commonPrefix(lhs, rhs) + 1);
+    if (width > 0) {
+        key.resize(width, '\0');
+    }
+    return key;
+}
+
+static int compareChars(const char *lhs, size_t lhsLen, const char *rhs,
+                        size_t rhsLen) {
+    int result = std::memcmp(lhs, rhs, std::min(lhsLen, rhsLen));
+    if (result != 0) {
+        return result > 0 ? 1 : -1;
+    }
+    return (lhsLen > rhsLen) - (lhsLen < rhsLen);
+}
+
+static inline uint32_t fromBigEndian(uint32_t value) {
+    return __builtin_bswap32(value);
+}
+
+static inline uint64_t fromBigEndian(uint64_t value) {
+    return __builtin_bswap64(value);
+}
+
+// Reads at most the first sizeof(Int) of `len` bytes as a big-endian
+// integer, padded with zero bytes.
+template <typename Int> static Int loadHead(const char *begin, size_t len) {
+    Int value = 0;
+    std::memcpy(&value, begin, std::min(len, sizeof(Int)));
+    return fromBigEndian(value);
+}
+
+// The key whose big-endian bytes an integer is.
+template <typename Int> static Key storeBytes(Int value) {
+    value = fromBigEndian(value);
+    return Key(reinterpret_cast<const char *>(&value), sizeof(Int));
+}
 
-    blk->resetPos(0);
-    blk->read(reinterpret_cast<char *>(&numKeys), sizeof(uint32_t));
-    blk->read(reinterpret_cast<char *>(&isLeafCnt), sizeof(uint32_t));
-    blk->read(reinterpret_cast<char *>(&parent), sizeof(Ptr));
+template <typename Int>
+static void packKeys(const std::vector<Key> &keys, char *dest) {
+    for (auto &key : keys) {
+        if (key.size() != sizeof(Int)) {
+            throw SysError("index key does not fit a packed node");
+        }
+        Int value = loadHead<Int>(key.data(), sizeof(Int));
+        std::memcpy(dest, &value, sizeof(Int));
+        dest += sizeof(Int);
+    }
+}
+
+template <typename Int>
+static void unpackKeys(const char *src, std::vector<Key> &keys) {
+    for (auto &key : keys) {
+        Int value;
+        std::memcpy(&value, src, sizeof(Int));
+        key = storeBytes(value);
+        src += sizeof(Int);
+    }
+}
+
+size_t Node::size() const {
+    if (width > 0) {
+        return packedSize(children.size(), keys.size(), width);
+    }
+    size_t sumLen = 0;
+    for (auto &key : keys) {
+        sumLen += key.size();
+    }
+    size_t prefixLen =
+        keys.empty() ? 0 : commonPrefix(keys.front(), keys.back());
+    return encodedSize(children.size(), keys.size(), prefixLen, sumLen);
+}
+
+void Node::readFromBlock(const char *data) {
+    uint32_t numKeys, isLeafCnt;
+    std::memcpy(&numKeys, data, sizeof(uint32_t));
+    std::memcpy(&isLeafCnt, data + sizeof(uint32_t), sizeof(uint32_t));
+    std::memcpy(&sibling, data + 2 * sizeof(uint32_t), sizeof(Ptr));
     isLeaf = (isLeafCnt == 1);
-    for (int i = 0; i <= numKeys; i++) {
-        blk->read(reinterpret_cast<char *>(&ptr), sizeof(Ptr));
-        children[i] = ptr;
+    children.resize(isLeaf ? numKeys : numKeys + 1);
+    keys.resize(numKeys);
+    if (width > 0) {
+        const char *pos = data + PACKED_HEADER_SIZE;
+        if (width == sizeof(uint32_t)) {
+            unpackKeys<uint32_t>(pos, keys);
+        } else {
+            unpackKeys<uint64_t>(pos, keys);
+        }
+        pos += numKeys * width;
+        std::memcpy(children.data(), pos, children.size() * sizeof(Ptr));
+        return;
     }
-    for (int i = 0; i < numKeys; i++) {
-        value.type = info.first;
-        value.charCnt = info.second;
-        blk->read(value.val(), value.size());
-        keys[i] = value;
+
+    uint16_t prefixLen;
+    std::memcpy(&prefixLen, data + 3 * sizeof(uint32_t), sizeof(uint16_t));
+    const char *prefix = data + HEADER_SIZE;
+    size_t pos = HEADER_SIZE + prefixLen;
+    if (!children.empty()) {
+        std::memcpy(children.data(), data + pos,
+                    children.size() * sizeof(Ptr));
+    }
+    pos += children.size() * sizeof(Ptr);
+
+    const char *suffixes = data + pos + numKeys * sizeof(uint16_t);
+    uint16_t start = 0, end;
+    for (uint32_t i = 0; i < numKeys; i++) {
+        std::memcpy(&end, data + pos + i * sizeof(uint16_t),
+                    sizeof(uint16_t));
+        keys[i].assign(prefix, prefixLen);
+        keys[i].append(suffixes + start, end - start);
+        start = end;
     }
 }
 
-void Node::writeToBlock(BM::BlockID id) {
-    uint32_t _offset = 0;
-    auto write = [&](const char *src, size_t size) {
-        BM::writeBlock(id, src, _offset, size);
-        _offset += size;
+size_t Node::encode(char *data) const {
+    if (size() > NODE_SIZE) {
+        throw SysError("index node overflow");
+    }
+    size_t pos = 0;
+    auto put = [&](const void *src, size_t size) {
+        if (size > 0) {
+            std::memcpy(data + pos, src, size);
+            pos += size;
+        }
     };
+    uint32_t numKeys = keys.size();
     uint32_t isLeafCnt = (isLeaf ? 1u : 0u);
-    write(reinterpret_cast<const char *>(&numKeys), sizeof(uint32_t));
-    write(reinterpret_cast<const char *>(&isLeafCnt), sizeof(uint32_t));
-    write(reinterpret_cast<const char *>(&parent), sizeof(Ptr));
-    for (int i = 0; i <= numKeys; i++) {
-        write(reinterpret_cast<const char *>(&children[i]), sizeof(Ptr));
+    put(&numKeys, sizeof(uint32_t));
+    put(&isLeafCnt, sizeof(uint32_t));
+    put(&sibling, sizeof(Ptr));
+    if (width > 0) {
+        uint32_t unused = 0;
+        put(&unused, sizeof(uint32_t));
+        if (width == sizeof(uint32_t)) {
+            packKeys<uint32_t>(keys, data + pos);
+        } else {
+            packKeys<uint64_t>(keys, data + pos);
+        }
+        pos += numKeys * width;
+        put(children.data(), children.size() * sizeof(Ptr));
+        return pos;
     }
-    for (int i = 0; i < numKeys; i++) {
-        write(keys[i].val(), keys[i].size());
+
+    uint16_t prefixLen =
+        keys.empty() ? 0 : commonPrefix(keys.front(), keys.back());
+    put(&prefixLen, sizeof(uint16_t));
+    if (prefixLen > 0) {
+        put(keys[0].data(), prefixLen);
     }
+    put(children.data(), children.size() * sizeof(Ptr));
+    uint16_t end = 0;
+    for (auto &key : keys) {
+        end += key.size() - prefixLen;
+        put(&end, sizeof(uint16_t));
+    }
+    for (auto &key : keys) {
+        put(key.data() + prefixLen, key.size() - prefixLen);
+    }
+    return pos;
 }
 
-std::tuple<Ptr, Off, bool> Tree::find(const Key &key) const {
-    if (root == NullPtr)
-        return std::make_tuple(NullPtr, NullPtr, false);
-    Ptr currOffset = root;
-    BM::PtrBlock blk = BM::readBlock(BM::makeID(filename, currOffset));
-    auto curr = std::make_shared<Node>(fanout);
-    curr->readFromBlock(blk, info);
-    while (!curr->isLeaf) {
-        Ptr nextOffset = NullPtr;
-        for (int i = 0; i < curr->numKeys; i++) {
-            if (curr->keys[i] == key) {
-                nextOffset = curr->children[i + 1];
-                break;
-            } else if (curr->keys[i] > key) {
-                nextOffset = curr->children[i];
-                break;
-            }
-            nextOffset = curr->children[i + 1];
+void Node::writeToBlock(BM::BlockID id) const {
+    char data[NODE_SIZE];
+    size_t size = encode(data);
+    BM::writeBlock(id, data, 0, size);
+}
+
+static bool isLeafPage(const char *data) {
+    uint32_t isLeafCnt;
+    std::memcpy(&isLeafCnt, data + sizeof(uint32_t), sizeof(uint32_t));
+    return isLeafCnt == 1;
+}
+
+// Where the parts of a prefix-compressed node page start. A page read
+// optimistically may be torn, so every part is kept within it; a layout
+// that does not fit is read as an empty node.
+struct Layout {
+    int numKeys;
+    size_t prefixLen;
+    const char *prefix, *children, *keys, *suffixes, *limit;
+    Layout(const char *data) : limit(data + NODE_SIZE) {
+        uint32_t num, isLeafCnt;
+        uint16_t len;
+        std::memcpy(&num, data, sizeof(uint32_t));
+        std::memcpy(&isLeafCnt, data + sizeof(uint32_t), sizeof(uint32_t));
+        std::memcpy(&len, data + 3 * sizeof(uint32_t), sizeof(uint16_t));
+        size_t numChildren = isLeafCnt == 1 ? num : size_t(num) + 1;
+        if (HEADER_SIZE + len + numChildren * sizeof(Ptr) +
+                size_t(num) * sizeof(uint16_t) >
+            NODE_SIZE) {
+            num = 0;
+            len = 0;
+            numChildren = isLeafCnt == 1 ? 0 : 1;
         }
-        blk = BM::readBlock(BM::makeID(filename, nextOffset));
-        curr->readFromBlock(blk, info);
-        currOffset = nextOffset;
+        numKeys = num;
+        prefixLen = len;
+        prefix = data + HEADER_SIZE;
+        children = prefix + prefixLen;
+        keys = children + numChildren * sizeof(Ptr);
+        suffixes = keys + num * sizeof(uint16_t);
     }
-    for (int i = 0; i < curr->numKeys; i++) {
-        if (curr->keys[i] == key) {
-            return std::make_tuple(currOffset, curr->children[i], true);
+    // bytes of the i-th key after the prefix
+    const char *suffix(int i, size_t &len) const {
+        uint16_t start = 0, end;
+        if (i > 0) {
+            std::memcpy(&start, keys + (i - 1) * sizeof(uint16_t),
+                        sizeof(uint16_t));
         }
+        std::memcpy(&end, keys + i * sizeof(uint16_t), sizeof(uint16_t));
+        size_t last = std::min<size_t>(end, limit - suffixes);
+        size_t first = std::min<size_t>(start, last);
+        len = last - first;
+        return suffixes + first;
     }
-    return std::make_tuple(currOffset, NullPtr, false);
-}
+};
 
-bool Tree::hasKey(const Key &key) const {
-    auto result = find(key);
-    return std::get<2>(result);
+// Where the parts of a packed node page start, kept within the page the
+// same way.
+template <typename Int> struct PackedLayout {
+    int numKeys;
+    const char *keys, *children, *limit;
+    PackedLayout(const char *data) : limit(data + NODE_SIZE) {
+        uint32_t num;
+        std::memcpy(&num, data, sizeof(uint32_t));
+        size_t numChildren = isLeafPage(data) ? num : size_t(num) + 1;
+        if (packedSize(numChildren, num, sizeof(Int)) > NODE_SIZE) {
+            num = 0;
+        }
+        numKeys = num;
+        keys = data + PACKED_HEADER_SIZE;
+        children = keys + num * sizeof(Int);
+    }
+    Int key(int i) const {
+        Int value;
+        std::memcpy(&value, keys + i * sizeof(Int), sizeof(Int));
+        return value;
+    }
+};
+
+static Ptr childAt(const char *children, const char *limit, int i) {
+    const char *pos = children + i * sizeof(Ptr);
+    if (pos + sizeof(Ptr) > limit) {
+        return NullPtr;
+    }
+    Ptr ptr;
+    std::memcpy(&ptr, pos, sizeof(Ptr));
+    return ptr;
 }
 
-void Tree::remove(const Key &key) const {}
+// Key traits that trees are instantiated on. Each reads the nodes of its
+// layout in place: the number of keys, the children, the keys and the
+// first slot whose key is not less than, or greater than, a given key.
+// A truncating comparison of a slot with a bound only looks at as many
+// bytes of the slot as the bound has, so that a bound on leading
+// attributes covers every key extending it. Keys compare as std::string
+// does in every layout.
 
-void Tree::insert(const Key &key, const Off &offset) {
-    Ptr leafOffset = NullPtr;
-    auto leaf = std::make_shared<Node>(fanout);
-    if (root == NullPtr) {
-        root = header.numBlocks++;
-        leafOffset = root;
-    } else {
-        auto result = find(key);
-        if (std::get<2>(result)) {
-            BM::BlockID id = BM::makeID(filename, std::get<0>(result));
-            BM::PtrBlock blk = BM::readBlock(id);
-            auto leaf = std::make_shared<Node>(fanout);
-            leaf->readFromBlock(blk, info);
-            for (int i = 0; i < leaf->numKeys; i++) {
-                if (leaf->keys[i] == key) {
-                    leaf->children[i] = offset;
-                    leaf->writeToBlock(id);
-                    return;
-                }
+// Prefix-compressed nodes, whose keys are searched by `Search` once the
+// prefix of the node has matched.
+template <typename Search> struct PrefixKeys {
+    static int numKeys(const char *page) { return Layout(page).numKeys; }
+
+    static Ptr child(const char *page, int i) {
+        Layout layout(page);
+        return childAt(layout.children, layout.limit, i);
+    }
+
+    static Key key(const char *page, int i) {
+        Layout layout(page);
+        size_t len;
+        const char *suffix = layout.suffix(i, len);
+        Key key(layout.prefix, layout.prefixLen);
+        key.append(suffix, len);
+        return key;
+    }
+
+    static int compare(const char *page, int i, const Key &key,
+                       bool truncate = false) {
+        Layout layout(page);
+        size_t prefixLen = layout.prefixLen, keyLen = key.size(), len;
+        size_t num = std::min(prefixLen, keyLen);
+        int result = compareChars(layout.prefix, truncate ? num : prefixLen,
+                                  key.data(), num);
+        if (result != 0 || keyLen < prefixLen) {
+            return result;
+        }
+        const char *suffix = layout.suffix(i, len);
+        size_t restLen = keyLen - prefixLen;
+        return compareChars(suffix, truncate ? std::min(len, restLen) : len,
+                            key.data() + prefixLen, restLen);
+    }
+
+    static int bound(const char *page, const Key &key, bool upper) {
+        Layout layout(page);
+        // the prefix either decides for every key of the node or for none
+        size_t prefixLen = layout.prefixLen, keyLen = key.size();
+        int result = compareChars(layout.prefix, prefixLen, key.data(),
+                                  std::min(prefixLen, keyLen));
+        if (result != 0) {
+            return result > 0 ? 0 : layout.numKeys;
+        }
+        return Search::bound(layout, key.data() + prefixLen,
+                             keyLen - prefixLen, upper);
+    }
+
+    static int lowerBound(const char *page, const Key &key) {
+        return bound(page, key, false);
+    }
+
+    static int upperBound(const char *page, const Key &key) {
+        return bound(page, key, true);
+    }
+
+    // However long the key and however much of the shared prefix it
+    // breaks up.
+    static bool hasRoom(const char *page) {
+        Layout layout(page);
+        size_t numKeys = layout.numKeys, sumLen = numKeys * layout.prefixLen;
+        if (numKeys > 0) {
+            size_t len;
+            const char *suffix = layout.suffix(numKeys - 1, len);
+            sumLen += suffix + len - layout.suffixes;
+        }
+        size_t numChildren = isLeafPage(page) ? numKeys : numKeys + 1;
+        return encodedSize(numChildren + 1, numKeys + 1, 0,
+                           sumLen + MAX_KEY_SIZE) <= NODE_SIZE;
+    }
+
+    // Encodes into `data` the leaf with an entry added, or its offset
+    // replaced if the key is there. Returns the bytes used, or 0 if the
+    // leaf would have to split.
+    static size_t insert(const char *page, const Key &key, Off offset,
+                         char *data) {
+        Node leaf(0);
+        leaf.readFromBlock(page);
+        auto iter = std::lower_bound(leaf.keys.begin(), leaf.keys.end(), key);
+        int i = iter - leaf.keys.begin();
+        if (iter != leaf.keys.end() && *iter == key) {
+            leaf.children[i] = offset;
+        } else {
+            leaf.keys.insert(iter, key);
+            leaf.children.insert(leaf.children.begin() + i, offset);
+            if (leaf.size() > NODE_SIZE) {
+                return 0;
             }
         }
-        leafOffset = std::get<0>(result);
-        BM::PtrBlock blk = BM::readBlock(BM::makeID(filename, leafOffset));
-        leaf->readFromBlock(blk, info);
+        return leaf.encode(data);
     }
-    if (leaf->numKeys < fanout - 1) {
-        int i = leaf->numKeys;
-        for (i--; i >= 0; i--) {
-            if (leaf->keys[i] > key) {
-                leaf->keys[i + 1] = leaf->keys[i];
-                leaf->children[i + 1] = leaf->children[i];
+};
+
+// Keys of no particular kind compare byte by byte.
+struct ByteSearch {
+    static int bound(const Layout &layout, const char *rest, size_t restLen,
+                     bool upper) {
+        int lo = 0, hi = layout.numKeys;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            size_t len;
+            const char *suffix = layout.suffix(mid, len);
+            int result = compareChars(suffix, len, rest, restLen);
+            if (result < 0 || (upper && result == 0)) {
+                lo = mid + 1;
             } else {
-                break;
+                hi = mid;
             }
         }
-        leaf->keys[i + 1] = key;
-        leaf->children[i + 1] = offset;
-        leaf->numKeys++;
-        leaf->writeToBlock(BM::makeID(filename, leafOffset));
-    } else {
-        Key *tmpKeys = new Key[fanout];
-        Ptr *tmpChildren = new Ptr[fanout];
-
-        std::copy(leaf->keys, leaf->keys + fanout - 1, tmpKeys);
-        std::copy(leaf->children, leaf->children + fanout - 1, tmpChildren);
+        return lo;
+    }
+};
 
-        int i = fanout - 1;
-        for (i--; i >= 0; i--) {
-            if (tmpKeys[i] > key) {
-                tmpKeys[i + 1] = tmpKeys[i];
-                tmpChildren[i + 1] = tmpChildren[i];
+// Keys led by a CHAR attribute compare their first eight bytes as integers,
+// which the zero padding of shorter ones keeps in byte order, and the rest
+// of the bytes only where those are equal.
+struct CharSearch {
+    static int bound(const Layout &layout, const char *rest, size_t restLen,
+                     bool upper) {
+        uint64_t target = loadHead<uint64_t>(rest, restLen);
+        int lo = 0, hi = layout.numKeys;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            size_t len;
+            const char *suffix = layout.suffix(mid, len);
+            uint64_t value = loadHead<uint64_t>(suffix, len);
+            int result = value != target
+                             ? (value < target ? -1 : 1)
+                             : compareChars(suffix, len, rest, restLen);
+            if (result < 0 || (upper && result == 0)) {
+                lo = mid + 1;
             } else {
-                break;
+                hi = mid;
             }
         }
-        tmpKeys[i + 1] = key;
-        tmpChildren[i + 1] = offset;
+        return lo;
+    }
+};
 
-        int numKeys0 = (fanout + 1) / 2;
-        int numKeys1 = fanout - numKeys0;
+using ByteKeys = PrefixKeys<ByteSearch>;
+using CharKeys = PrefixKeys<CharSearch>;
 
-        auto leaf0 = leaf;
-        auto leaf1 = std::make_shared<Node>(fanout);
-        Ptr leafOffset0 = leafOffset;
-        Ptr leafOffset1 = header.numBlocks++;
+// Keys of the width of Int, such as those of an INT or FLOAT attribute with
+// or without the offset of a non-unique index, in packed nodes. Both types
+// are encoded to sort as their big-endian bytes, so the keys compare as
+// integers, separators included. A key shorter than the slots, on leading
+// attributes only, sorts before every slot that extends it, which is the
+// slot padded with zero bytes; so does a longer one after every slot it
+// extends.
+template <typename Int> struct WordKeys {
+    static int numKeys(const char *page) {
+        return PackedLayout<Int>(page).numKeys;
+    }
 
-        leaf1->isLeaf = true;
-        leaf1->parent = leaf0->parent;
+    static Ptr child(const char *page, int i) {
+        PackedLayout<Int> layout(page);
+        return childAt(layout.children, layout.limit, i);
+    }
 
-        leaf0->numKeys = numKeys0;
-        leaf1->numKeys = numKeys1;
+    static Key key(const char *page, int i) {
+        return storeBytes(PackedLayout<Int>(page).key(i));
+    }
 
-        leaf1->children[fanout - 1] = leaf0->children[fanout - 1];
-        leaf0->children[fanout - 1] = leafOffset1;
+    static int compare(const char *page, int i, const Key &key,
+                       bool truncate = false) {
+        Int value = PackedLayout<Int>(page).key(i);
+        size_t keyLen = key.size(), len = std::min(keyLen, sizeof(Int));
+        if (len > 0) {
+            size_t shift = 8 * (sizeof(Int) - len);
+            Int lhs = value >> shift;
+            Int rhs = loadHead<Int>(key.data(), keyLen) >> shift;
+            if (lhs != rhs) {
+                return lhs < rhs ? -1 : 1;
+            }
+        }
+        size_t slotLen = truncate ? len : sizeof(Int);
+        return (slotLen > keyLen) - (slotLen < keyLen);
+    }
+
+    static int bound(const char *page, const Key &key, bool upper) {
+        PackedLayout<Int> layout(page);
+        size_t keyLen = key.size();
+        Int target = loadHead<Int>(key.data(), keyLen);
+        // slots equal to the target sort before a full key they are an
+        // upper bound of, and before a longer key
+        if (keyLen > sizeof(Int) || (upper && keyLen == sizeof(Int))) {
+            if (target == std::numeric_limits<Int>::max()) {
+                return layout.numKeys;
+            }
+            target++;
+        }
+        int lo = 0, hi = layout.numKeys;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (layout.key(mid) < target) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
 
-        std::fill_n(leaf0->children, fanout - 1, NullPtr);
-        std::fill_n(leaf1->children, fanout - 1, NullPtr);
+    static int lowerBound(const char *page, const Key &key) {
+        return bound(page, key, false);
+    }
+
+    static int upperBound(const char *page, const Key &key) {
+        return bound(page, key, true);
+    }
+
+    static bool hasRoom(const char *page) {
+        PackedLayout<Int> layout(page);
+        size_t numKeys = layout.numKeys;
+        size_t numChildren = isLeafPage(page) ? numKeys : numKeys + 1;
+        return packedSize(numChildren + 1, numKeys + 1, sizeof(Int)) <=
+               NODE_SIZE;
+    }
 
-        for (int i = 0; i < numKeys0; i++) {
-            leaf0->keys[i] = tmpKeys[i];
-            leaf0->children[i] = tmpChildren[i];
+    // As PrefixKeys::insert, splicing the entry into the packed arrays.
+    static size_t insert(const char *page, const Key &key, Off offset,
+                         char *data) {
+        if (key.size() != sizeof(Int)) {
+            throw SysError("index key does not fit a packed node");
         }
+        PackedLayout<Int> layout(page);
+        size_t numKeys = layout.numKeys;
+        size_t i = lowerBound(page, key);
+        Int value = loadHead<Int>(key.data(), sizeof(Int));
+        bool found = i < numKeys && layout.key(i) == value;
+        size_t num = found ? numKeys : numKeys + 1;
+        size_t size = packedSize(num, num, sizeof(Int));
+        if (size > NODE_SIZE) {
+            return 0;
+        }
+        std::memcpy(data, page, PACKED_HEADER_SIZE);
+        uint32_t numKeys1 = num;
+        std::memcpy(data, &numKeys1, sizeof(uint32_t));
+        size_t rest = found ? numKeys - i - 1 : numKeys - i;
+        char *keys = data + PACKED_HEADER_SIZE;
+        std::memcpy(keys, layout.keys, i * sizeof(Int));
+        std::memcpy(keys + i * sizeof(Int), &value, sizeof(Int));
+        std::memcpy(keys + (i + 1) * sizeof(Int),
+                    layout.keys + (numKeys - rest) * sizeof(Int),
+                    rest * sizeof(Int));
+        char *children = keys + num * sizeof(Int);
+        std::memcpy(children, layout.children, i * sizeof(Ptr));
+        std::memcpy(children + i * sizeof(Ptr), &offset, sizeof(Ptr));
+        std::memcpy(children + (i + 1) * sizeof(Ptr),
+                    layout.children + (numKeys - rest) * sizeof(Ptr),
+                    rest * sizeof(Ptr));
+        return size;
+    }
+};
 
-        if (numKeys0 < fanout - 1) {
-            leaf0->children[numKeys0] = NullPtr;
+NodeView::NodeView(const Tree &tree)
+    : tree(tree), offset(NullPtr), hold(Hold::OPTIMISTIC), version(0) {}
+
+NodeView::NodeView(const Tree &tree, Ptr offset) : NodeView(tree) {
+    load(offset);
+}
+
+NodeView::~NodeView() { release(); }
+
+void NodeView::load(Ptr offset, Hold hold) {
+    bool room;
+    auto next = tree.pin(offset, room);
+    uint64_t nextVersion = 0;
+    switch (hold) {
+    case Hold::OPTIMISTIC:
+        nextVersion = next->latch.stableVersion();
+        break;
+    case Hold::SHARED:
+        next->latch.lockShared();
+        break;
+    case Hold::EXCLUSIVE:
+        next->latch.lock();
+        break;
+    }
+    // a torn read only keeps a page pinned that did not need to be
+    if (room && !isLeafPage(next->block_data)) {
+        tree.keep(offset, next);
+    }
+    release();
+    blk = next;
+    this->offset = offset;
+    this->hold = hold;
+    version = nextVersion;
+}
+
+// The child is only pinned once the pointer to it is known to have been
+// read from a node as it was, and only counts as the child if the node
+// still is once the child's version is read.
+bool NodeView::couple(Ptr child) {
+    if (!validate()) {
+        release();
+        return false;
+    }
+    auto parent = blk;
+    parent->pin();
+    uint64_t parentVersion = version;
+    load(child);
+    bool valid = parent->latch.validate(parentVersion);
+    parent->unpin();
+    if (!valid) {
+        release();
+    }
+    return valid;
+}
+
+bool NodeView::validate() const { return blk->latch.validate(version); }
+
+bool NodeView::upgrade(Hold hold) {
+    bool latched = hold == Hold::SHARED ? blk->latch.lockSharedAt(version)
+                                        : blk->latch.lockAt(version);
+    if (!latched) {
+        release();
+        return false;
+    }
+    this->hold = hold;
+    return true;
+}
+
+void NodeView::release() {
+    if (!blk) {
+        return;
+    }
+    if (hold == Hold::EXCLUSIVE) {
+        blk->latch.unlock();
+    } else if (hold == Hold::SHARED) {
+        blk->latch.unlockShared();
+    }
+    blk->unpin();
+    blk.reset();
+}
+
+bool NodeView::isLeaf() const { return isLeafPage(blk->block_data); }
+
+Ptr NodeView::sibling() const {
+    Ptr ptr;
+    std::memcpy(&ptr, blk->block_data + 2 * sizeof(uint32_t), sizeof(Ptr));
+    return ptr;
+}
+
+Tree::Tree(size_t keyWidth) : root(NullPtr), epoch(0), keyWidth(keyWidth) {}
+
+Cursor::Cursor(const Tree &tree, const Key *lo, bool loInclusive,
+               const Key *hi, bool hiInclusive)
+    : tree(tree), hasLo(lo != nullptr), loInclusive(loInclusive),
+      hasHi(hi != nullptr), hiInclusive(hiInclusive), hasLast(false),
+      leaf(NullPtr), epoch(0) {
+    if (hasLo) {
+        this->lo = *lo;
+    }
+    if (hasHi) {
+        this->hi = *hi;
+    }
+    tree.start(*this);
+}
+
+bool Cursor::next(std::vector<Off> &offsets, size_t max,
+                  std::vector<Key> *keys) {
+    if (leaf == NullPtr) {
+        return false;
+    }
+    return tree.next(*this, offsets, max, keys);
+}
+
+Cursor Tree::seek(const Key *lo, bool loInclusive, const Key *hi,
+                  bool hiInclusive) const {
+    return Cursor(*this, lo, loInclusive, hi, hiInclusive);
+}
+
+std::vector<Off> Tree::range(const Key *lo, bool loInclusive, const Key *hi,
+                             bool hiInclusive) const {
+    std::vector<Off> offsets;
+    auto cursor = seek(lo, loInclusive, hi, hiInclusive);
+    while (cursor.next(offsets, SIZE_MAX)) {
+    }
+    return offsets;
+}
+
+bool Tree::hasKey(const Key &key) const {
+    auto result = find(key);
+    return std::get<2>(result);
+}
+
+// Gives an empty tree its first leaf, with the tree to itself. Returns
+// false if another insert gave it one first.
+bool Tree::insertFirst(const Key &key, const Off &offset) {
+    BM::LatchGuard guard(latch, true);
+    if (root != NullPtr) {
+        return false;
+    }
+    Node leaf(keyWidth);
+    leaf.isLeaf = true;
+    leaf.keys.push_back(key);
+    leaf.children.push_back(offset);
+    Ptr leafOffset = allocate();
+    leaf.writeToBlock(BM::makeID(filename, leafOffset));
+    root = leafOffset;
+    writeHeader();
+    return true;
+}
+
+// The lookups, scans and inserts of a tree, instantiated per key traits.
+template <typename Keys> struct TypedTree : Tree {
+    explicit TypedTree(size_t keyWidth) : Tree(keyWidth) {}
+    std::tuple<Ptr, Off, bool> find(const Key &) const override;
+    void remove(const Key &) override;
+    void insert(const Key &, const Off &) override;
+    void insertBatch(const std::vector<std::pair<Key, Off>> &) override;
+
+  protected:
+    void start(Cursor &) const override;
+    bool next(Cursor &, std::vector<Off> &, size_t,
+              std::vector<Key> *) const override;
+
+  private:
+    bool descend(NodeView &, const Key *, Hold) const;
+    bool insertLeaf(NodeView &, const Key &, const Off &);
+    size_t insertRun(const std::vector<std::pair<Key, Off>> &, size_t);
+    void insertPath(const Key &, const Off &);
+    Ptr findLeaf(const Key &, std::vector<Ptr> &) const;
+};
+
+template <typename Keys>
+Ptr TypedTree<Keys>::findLeaf(const Key &key, std::vector<Ptr> &path) const {
+    Ptr currOffset = root;
+    NodeView curr(*this, currOffset);
+    while (!curr.isLeaf()) {
+        path.push_back(currOffset);
+        const char *page = curr.page();
+        currOffset = Keys::child(page, Keys::upperBound(page, key));
+        curr.load(currOffset);
+    }
+    return currOffset;
+}
+
+// Holds in `view` the leaf that a key belongs in, or the first leaf if
+// there is no key, as asked for. Returns false if the tree is empty.
+template <typename Keys>
+bool TypedTree<Keys>::descend(NodeView &view, const Key *key,
+                              Hold hold) const {
+    for (;;) {
+        Ptr offset = root;
+        if (offset == NullPtr) {
+            view.release();
+            return false;
+        }
+        view.load(offset);
+        // a split replaces the root while the old one is latched, so once
+        // its version is read the root it was read as must still be it
+        if (root != offset) {
+            continue;
         }
+        bool valid = true;
+        while (valid && !view.isLeaf()) {
+            const char *page = view.page();
+            int i = key != nullptr ? Keys::upperBound(page, *key) : 0;
+            valid = view.couple(Keys::child(page, i));
+        }
+        if (valid && (hold == Hold::OPTIMISTIC || view.upgrade(hold))) {
+            return true;
+        }
+    }
+}
 
-        for (int i = 0, j = numKeys0; i < numKeys1; i++, j++) {
-            leaf1->keys[i] = tmpKeys[j];
-            leaf1->children[i] = tmpChildren[j];
+template <typename Keys>
+std::tuple<Ptr, Off, bool> TypedTree<Keys>::find(const Key &key) const {
+    BM::LatchGuard guard(latch, false);
+    NodeView leaf(*this);
+    for (;;) {
+        if (!descend(leaf, &key, Hold::OPTIMISTIC)) {
+            return std::make_tuple(NullPtr, NullPtr, false);
         }
+        const char *page = leaf.page();
+        int i = Keys::lowerBound(page, key);
+        bool found =
+            i < Keys::numKeys(page) && Keys::compare(page, i, key) == 0;
+        Off offset = found ? Keys::child(page, i) : NullPtr;
+        if (leaf.validate()) {
+            return std::make_tuple(leaf.offset, offset, found);
+        }
+    }
+}
 
-        delete[] tmpKeys;
-        delete[] tmpChildren;
+template <typename Keys> void TypedTree<Keys>::start(Cursor &cursor) const {
+    BM::LatchGuard guard(latch, false);
+    NodeView curr(*this);
+    if (descend(curr, cursor.hasLo ? &cursor.lo : nullptr, Hold::SHARED)) {
+        cursor.leaf = curr.offset;
+        cursor.epoch = epoch;
+    }
+}
 
-        leaf0->writeToBlock(BM::makeID(filename, leafOffset0));
-        leaf1->writeToBlock(BM::makeID(filename, leafOffset1));
+template <typename Keys>
+bool TypedTree<Keys>::next(Cursor &cursor, std::vector<Off> &offsets,
+                           size_t max, std::vector<Key> *keys) const {
+    auto &lo = cursor.lo, &hi = cursor.hi, &last = cursor.last;
+    bool hasLo = cursor.hasLo, hasHi = cursor.hasHi;
+    BM::LatchGuard guard(latch, false);
+    NodeView curr(*this);
+    if (cursor.epoch != epoch) {
+        if (!descend(curr, cursor.hasLast ? &last : hasLo ? &lo : nullptr,
+                     Hold::SHARED)) {
+            cursor.leaf = NullPtr;
+            return false;
+        }
+        cursor.epoch = epoch;
+    } else {
+        curr.load(cursor.leaf, Hold::SHARED);
+    }
+    const char *page = curr.page();
+    int pos = cursor.hasLast ? Keys::upperBound(page, last)
+              : hasLo        ? Keys::lowerBound(page, lo)
+                             : 0;
+    // an exclusive lower bound passes over every key extending it
+    bool skipLo = !cursor.hasLast && hasLo && !cursor.loInclusive;
+    size_t num = 0;
+    for (;;) {
+        for (int numKeys = Keys::numKeys(page); pos < numKeys; pos++) {
+            if (skipLo) {
+                if (Keys::compare(page, pos, lo, true) == 0) {
+                    continue;
+                }
+                skipLo = false;
+            }
+            if (hasHi) {
+                int result = Keys::compare(page, pos, hi, true);
+                if (cursor.hiInclusive ? result > 0 : result >= 0) {
+                    cursor.leaf = NullPtr;
+                    return false;
+                }
+            }
+            offsets.push_back(Keys::child(page, pos));
+            if (keys != nullptr) {
+                keys->push_back(Keys::key(page, pos));
+            }
+            if (++num == max) {
+                last = Keys::key(page, pos);
+                cursor.hasLast = true;
+                cursor.leaf = curr.offset;
+                return true;
+            }
+        }
+        Ptr sibling = curr.sibling();
+        if (sibling == NullPtr) {
+            cursor.leaf = NullPtr;
+            return false;
+        }
+        curr.load(sibling, Hold::SHARED);
+        page = curr.page();
+        // keys up to the last one returned may have moved here by a split
+        pos = cursor.hasLast ? Keys::upperBound(page, last) : 0;
+    }
+}
 
-        insert_in_parent(leafOffset0, leaf1->keys[0], leafOffset1);
+template <typename Keys> void TypedTree<Keys>::remove(const Key &key) {
+    BM::LatchGuard guard(latch, true);
+    epoch++;
+    if (root == NullPtr) {
+        return;
+    }
+    std::vector<Ptr> path;
+    Ptr leafOffset = findLeaf(key, path);
+    Node leaf(keyWidth);
+    leaf.readFromBlock(BM::readBlock(BM::makeID(filename, leafOffset)));
+    auto iter = std::lower_bound(leaf.keys.begin(), leaf.keys.end(), key);
+    if (iter == leaf.keys.end() || *iter != key) {
+        return;
     }
+    leaf.children.erase(leaf.children.begin() + (iter - leaf.keys.begin()));
+    leaf.keys.erase(iter);
+    remove_entry(path, leafOffset, leaf);
+    writeHeader();
 }
 
-void Tree::insert_in_parent(const Ptr &nodeOffset0, const Key &key,
-                            const Ptr &nodeOffset1) {
-    BM::PtrBlock blk0 = BM::readBlock(BM::makeID(filename, nodeOffset0));
-    BM::PtrBlock blk1 = BM::readBlock(BM::makeID(filename, nodeOffset1));
-    auto node0 = std::make_shared<Node>(fanout);
-    auto node1 = std::make_shared<Node>(fanout);
-    node0->readFromBlock(blk0, info);
-    node1->readFromBlock(blk1, info);
-    if (node0->isRoot()) {
-        Ptr rootOffset = header.numBlocks++;
-        auto root = std::make_shared<Node>(fanout);
-        root->numKeys = 1;
-        root->keys[0] = key;
-        root->children[0] = nodeOffset0;
-        root->children[1] = nodeOffset1;
-        node0->parent = rootOffset;
-        node1->parent = rootOffset;
-        node0->writeToBlock(BM::makeID(filename, nodeOffset0));
-        node1->writeToBlock(BM::makeID(filename, nodeOffset1));
-        root->writeToBlock(BM::makeID(filename, rootOffset));
-        this->root = rootOffset;
-        this->header.rootOffset = rootOffset;
-    } else {
-        Ptr parentOffset = node0->parent;
-        BM::PtrBlock blkP = BM::readBlock(BM::makeID(filename, parentOffset));
-        auto parent = std::make_shared<Node>(fanout);
-        parent->readFromBlock(blkP, info);
-        if (parent->numKeys < fanout - 1) {
-            int i = parent->numKeys;
-            for (; i >= 0; i--) {
-                if (parent->children[i] != nodeOffset0) {
-                    parent->children[i + 1] = parent->children[i];
-                    parent->keys[i] = parent->keys[i - 1];
-                } else {
-                    break;
+template <typename Keys>
+void TypedTree<Keys>::insert(const Key &key, const Off &offset) {
+    for (;;) {
+        {
+            BM::LatchGuard guard(latch, false);
+            NodeView leaf(*this);
+            if (descend(leaf, &key, Hold::EXCLUSIVE)) {
+                if (!insertLeaf(leaf, key, offset)) {
+                    leaf.release();
+                    insertPath(key, offset);
                 }
+                return;
+            }
+        }
+        if (insertFirst(key, offset)) {
+            return;
+        }
+    }
+}
+
+// Adds a key to the leaf latched exclusively in the view, unless the leaf
+// would have to split. Returns whether the key was added.
+template <typename Keys>
+bool TypedTree<Keys>::insertLeaf(NodeView &view, const Key &key,
+                                 const Off &offset) {
+    char data[NODE_SIZE];
+    size_t size = Keys::insert(view.page(), key, offset, data);
+    if (size == 0) {
+        return false;
+    }
+    BM::writeBlock(BM::makeID(filename, view.offset), data, 0, size);
+    return true;
+}
+
+template <typename Keys>
+void TypedTree<Keys>::insertBatch(
+    const std::vector<std::pair<Key, Off>> &entries) {
+    size_t i = 0;
+    while (i < entries.size()) {
+        size_t num = insertRun(entries, i);
+        if (num == 0) {
+            insert(entries[i].first, entries[i].second);
+            num = 1;
+        }
+        i += num;
+    }
+}
+
+// Adds the entries from `first` on to the leaf of the first one, for as
+// long as they surely belong in it and it has room. A key belongs in the
+// leaf if it is no greater than one already there, or if the leaf is the
+// last one. Returns the number of entries added, which is 0 if the tree is
+// empty or the first entry splits its leaf.
+template <typename Keys>
+size_t TypedTree<Keys>::insertRun(
+    const std::vector<std::pair<Key, Off>> &entries, size_t first) {
+    BM::LatchGuard guard(latch, false);
+    NodeView view(*this);
+    if (!descend(view, &entries[first].first, Hold::EXCLUSIVE)) {
+        return 0;
+    }
+    Node leaf(keyWidth);
+    leaf.readFromBlock(view.page());
+    Key high = entries[first].first;
+    if (!leaf.keys.empty() && high < leaf.keys.back()) {
+        high = leaf.keys.back();
+    }
+    size_t i = first;
+    for (; i < entries.size(); i++) {
+        auto &key = entries[i].first;
+        if (leaf.sibling != NullPtr && high < key) {
+            break;
+        }
+        auto iter = std::lower_bound(leaf.keys.begin(), leaf.keys.end(), key);
+        int pos = iter - leaf.keys.begin();
+        if (iter != leaf.keys.end() && *iter == key) {
+            leaf.children[pos] = entries[i].second;
+            continue;
+        }
+        leaf.keys.insert(iter, key);
+        leaf.children.insert(leaf.children.begin() + pos, entries[i].second);
+        if (leaf.size() > NODE_SIZE) {
+            leaf.keys.erase(leaf.keys.begin() + pos);
+            leaf.children.erase(leaf.children.begin() + pos);
+            break;
+        }
+    }
+    if (i > first) {
+        leaf.writeToBlock(BM::makeID(filename, view.offset));
+    }
+    return i - first;
+}
+
+// Inserts a key that splits its leaf. The path down to the leaf is read
+// optimistically; then the nodes from the lowest one with room for another
+// entry down, where the split stops, are latched exclusively top-down at
+// the versions they were read at. If any of them changed, it starts over.
+template <typename Keys>
+void TypedTree<Keys>::insertPath(const Key &key, const Off &offset) {
+    // root side first; views let go of their nodes when they are dropped
+    std::vector<std::unique_ptr<NodeView>> path;
+    for (;;) {
+        path.clear();
+        Ptr rootOffset = root;
+        path.emplace_back(new NodeView(*this));
+        path.back()->load(rootOffset);
+        if (root != rootOffset) {
+            continue;
+        }
+        bool valid = true;
+        while (valid && !path.back()->isLeaf()) {
+            // coupled as in NodeView::couple, keeping the node
+            NodeView &node = *path.back();
+            const char *page = node.page();
+            Ptr child = Keys::child(page, Keys::upperBound(page, key));
+            valid = node.validate();
+            if (valid) {
+                path.emplace_back(new NodeView(*this));
+                path.back()->load(child);
+                valid = node.validate();
             }
-            parent->children[i + 1] = nodeOffset1;
-            parent->keys[i] = key;
-            parent->numKeys++;
-            parent->writeToBlock(BM::makeID(filename, parentOffset));
+        }
+        if (!valid) {
+            continue;
+        }
+        size_t first = path.size() - 1;
+        while (first > 0 && !Keys::hasRoom(path[first - 1]->page())) {
+            first--;
+        }
+        first = first > 0 ? first - 1 : 0;
+        size_t i = first;
+        while (i < path.size() && path[i]->upgrade(Hold::EXCLUSIVE)) {
+            i++;
+        }
+        if (i == path.size()) {
+            path.erase(path.begin(), path.begin() + first);
+            break;
+        }
+    }
+    // ancestors of the leaf; the split consumes them on its way up
+    std::vector<Ptr> ancestors;
+    for (size_t i = 0; i + 1 < path.size(); i++) {
+        ancestors.push_back(path[i]->offset);
+    }
+    Node node(keyWidth);
+    node.readFromBlock(path.back()->page());
+    auto iter = std::lower_bound(node.keys.begin(), node.keys.end(), key);
+    int i = iter - node.keys.begin();
+    if (iter != node.keys.end() && *iter == key) {
+        node.children[i] = offset;
+    } else {
+        node.keys.insert(iter, key);
+        node.children.insert(node.children.begin() + i, offset);
+    }
+    store(ancestors, path.back()->offset, node);
+    writeHeader();
+}
+
+// Picks where to split a node that does not fit, as the point that best
+// balances the encoded halves. A leaf keeps keys [0, m) and an internal
+// node moves key m up to its parent.
+static int splitPoint(const Node &node) {
+    int numKeys = node.keys.size();
+    std::vector<size_t> sumLen(numKeys + 1, 0);
+    for (int i = 0; i < numKeys; i++) {
+        sumLen[i + 1] = sumLen[i] + node.keys[i].size();
+    }
+    auto size = [&](int first, int last, size_t numChildren) {
+        size_t prefixLen =
+            first < last ? commonPrefix(node.keys[first], node.keys[last - 1])
+                         : 0;
+        return encodedSize(numChildren, last - first, prefixLen,
+                           sumLen[last] - sumLen[first]);
+    };
+    int best = -1;
+    size_t bestSize = SIZE_MAX;
+    for (int m = node.isLeaf ? 1 : 0; m < numKeys; m++) {
+        size_t size0, size1;
+        if (node.isLeaf) {
+            size0 = size(0, m, m);
+            size1 = size(m, numKeys, numKeys - m);
         } else {
-            Key *tmpKeys = new Key[fanout];
-            Ptr *tmpChildren = new Ptr[fanout + 1];
+            size0 = size(0, m, m + 1);
+            size1 = size(m + 1, numKeys, numKeys - m);
+        }
+        if (size0 <= NODE_SIZE && size1 <= NODE_SIZE &&
+            std::max(size0, size1) < bestSize) {
+            best = m;
+            bestSize = std::max(size0, size1);
+        }
+    }
+    if (best < 0) {
+        throw SysError("index node cannot be split");
+    }
+    return best;
+}
 
-            std::fill_n(tmpChildren, fanout + 1, NullPtr);
+void Tree::store(std::vector<Ptr> &path, const Ptr &nodeOffset, Node &node) {
+    if (node.size() <= NODE_SIZE) {
+        node.writeToBlock(BM::makeID(filename, nodeOffset));
+        return;
+    }
+    int m = splitPoint(node);
+    Node node1(keyWidth);
+    Key key;
+    node1.isLeaf = node.isLeaf;
+    if (node.isLeaf) {
+        key = separator(node.keys[m - 1], node.keys[m], keyWidth);
+        node1.keys.assign(node.keys.begin() + m, node.keys.end());
+        node1.children.assign(node.children.begin() + m, node.children.end());
+        node.keys.resize(m);
+        node.children.resize(m);
+    } else {
+        key = node.keys[m];
+        node1.keys.assign(node.keys.begin() + m + 1, node.keys.end());
+        node1.children.assign(node.children.begin() + m + 1,
+                              node.children.end());
+        node.keys.resize(m);
+        node.children.resize(m + 1);
+    }
+    Ptr nodeOffset1 = allocate();
+    node1.sibling = node.sibling;
+    node.sibling = node.isLeaf ? nodeOffset1 : NullPtr;
+    node.writeToBlock(BM::makeID(filename, nodeOffset));
+    node1.writeToBlock(BM::makeID(filename, nodeOffset1));
+    insert_in_parent(path, nodeOffset, key, nodeOffset1);
+}
 
-            std::copy(parent->keys, parent->keys + fanout - 1, tmpKeys);
-            std::copy(parent->children, parent->children + fanout, tmpChildren);
+void Tree::bulkLoad(const std::function<bool(Key &, Off &)> &next,
+                    double fillFactor) {
+    BM::LatchGuard guard(latch, true);
+    if (root != NullPtr) {
+        throw SysError("bulk load into a non-empty index");
+    }
+    // Each level fills one node at a time. The last completed node is held
+    // back until the next one is started, so that its sibling is known and
+    // the two can be balanced when the input runs out. `low` is the key
+    // under which the current node is entered from its parent.
+    struct Level {
+        explicit Level(size_t width) : prev(width), curr(width) {}
+        Node prev, curr;
+        Key low;
+        size_t sumLen = 0;
+        Ptr prevOffset = NullPtr;
+        int numNodes = 0;
+    };
+    std::vector<Level> levels;
+    size_t target =
+        std::max(MIN_NODE_SIZE,
+                 std::min(NODE_SIZE,
+                          static_cast<size_t>(NODE_SIZE * fillFactor)));
+    std::function<void(size_t, const Key &, Ptr)> push;
+    auto close = [&](size_t level) {
+        Ptr offset = allocate();
+        auto &l = levels[level];
+        Key key = l.low;
+        if (!l.prev.children.empty()) {
+            l.prev.sibling = l.prev.isLeaf ? offset : NullPtr;
+            l.prev.writeToBlock(BM::makeID(filename, l.prevOffset));
+            if (l.curr.isLeaf) {
+                key = separator(l.prev.keys.back(), l.curr.keys.front(),
+                                keyWidth);
+            }
+        }
+        l.prev = std::move(l.curr);
+        l.curr = Node(keyWidth);
+        l.sumLen = 0;
+        l.prevOffset = offset;
+        l.numNodes++;
+        push(level + 1, key, offset);
+    };
+    push = [&](size_t level, const Key &key, Ptr ptr) {
+        while (levels.size() <= level) {
+            levels.emplace_back(keyWidth);
+        }
+        auto *l = &levels[level];
+        if (!l->curr.children.empty()) {
+            auto &first = l->curr.keys.empty() ? key : l->curr.keys.front();
+            size_t numChildren = l->curr.children.size() + 1;
+            size_t numKeys = l->curr.keys.size() + 1;
+            size_t size =
+                keyWidth > 0
+                    ? packedSize(numChildren, numKeys, keyWidth)
+                    : encodedSize(numChildren, numKeys,
+                                  commonPrefix(first, key),
+                                  l->sumLen + key.size());
+            if (size > target) {
+                close(level);
+                l = &levels[level];
+            }
+        }
+        auto &node = l->curr;
+        if (node.children.empty()) {
+            node.isLeaf = (level == 0);
+            l->low = key;
+        }
+        if (node.isLeaf || !node.children.empty()) {
+            node.keys.push_back(key);
+            l->sumLen += key.size();
+        }
+        node.children.push_back(ptr);
+    };
 
-            int i = fanout;
-            for (i--; i > 0; i--) {
-                if (tmpChildren[i] != nodeOffset0) {
-                    tmpChildren[i + 1] = tmpChildren[i];
-                    tmpKeys[i] = tmpKeys[i - 1];
-                } else {
-                    break;
-                }
+    Key key;
+    Off offset;
+    while (next(key, offset)) {
+        push(0, key, offset);
+    }
+    for (size_t level = 0; level < levels.size(); level++) {
+        auto *l = &levels[level];
+        if (!l->curr.children.empty() && !l->prev.children.empty() &&
+            l->curr.size() < MIN_NODE_SIZE) {
+            Node all = l->prev;
+            if (!all.isLeaf) {
+                all.keys.push_back(l->low);
             }
-            tmpChildren[i + 1] = nodeOffset1;
-            tmpKeys[i] = key;
-
-            int numDiv2 = (fanout + 1) / 2;
-            int numKeys0 = numDiv2 - 1;
-            int numKeys1 = fanout - numDiv2;
-
-            auto parent0 = parent;
-            auto parent1 = std::make_shared<Node>(fanout);
-            Ptr parentOffset0 = parentOffset;
-            Ptr parentOffset1 = header.numBlocks++;
-
-            parent1->parent = parent0->parent;
-
-            parent0->numKeys = numKeys0;
-            parent1->numKeys = numKeys1;
-
-            std::fill_n(parent0->children, fanout, NullPtr);
-            std::fill_n(parent1->children, fanout, NullPtr);
-
-            std::copy(tmpKeys, tmpKeys + numKeys0, parent0->keys);
-            std::copy(tmpChildren, tmpChildren + numKeys0 + 1,
-                      parent0->children);
-            Key key1 = tmpKeys[numKeys0];
-            std::copy(tmpKeys + numKeys0 + 1, tmpKeys + fanout, parent1->keys);
-            std::copy(tmpChildren + numKeys0 + 1, tmpChildren + fanout + 1,
-                      parent1->children);
-
-            for (int i = 0; i <= numKeys1; i++) {
-                Ptr childOffset = parent1->children[i];
-                BM::PtrBlock blkT =
-                    BM::readBlock(BM::makeID(filename, childOffset));
-                auto child = std::make_shared<Node>(fanout);
-                child->readFromBlock(blkP, info);
-                child->parent = parentOffset1;
-                child->writeToBlock(BM::makeID(filename, childOffset));
+            all.keys.insert(all.keys.end(), l->curr.keys.begin(),
+                            l->curr.keys.end());
+            all.children.insert(all.children.end(), l->curr.children.begin(),
+                                l->curr.children.end());
+            if (all.size() <= NODE_SIZE) {
+                l->prev = std::move(all);
+                l->curr = Node(keyWidth);
+            } else {
+                int m = splitPoint(all);
+                int num0 = all.isLeaf ? m : m + 1;
+                l->curr.keys.assign(all.keys.begin() + num0, all.keys.end());
+                l->curr.children.assign(all.children.begin() + num0,
+                                        all.children.end());
+                if (!all.isLeaf) {
+                    l->low = all.keys[m];
+                }
+                all.keys.resize(m);
+                all.children.resize(num0);
+                l->prev = std::move(all);
             }
+        }
+        if (!l->curr.children.empty()) {
+            close(level);
+            l = &levels[level];
+        }
+        if (l->prev.children.empty()) {
+            continue;
+        }
+        l->prev.sibling = NullPtr;
+        l->prev.writeToBlock(BM::makeID(filename, l->prevOffset));
+        if (l->numNodes == 1) {
+            root = l->prevOffset;
+            break;
+        }
+    }
+    writeHeader();
+}
+
+Tree::~Tree() {
+    for (auto &entry : inner) {
+        entry.second->unpin();
+    }
+}
+
+BM::PtrBlock Tree::pin(Ptr offset, bool &room) const {
+    {
+        BM::LatchGuard guard(innerLatch, false);
+        auto iter = inner.find(offset);
+        if (iter != inner.end()) {
+            iter->second->pin();
+            room = false;
+            return iter->second;
+        }
+        room = inner.size() < INNER_CACHE_SIZE;
+    }
+    return BM::pinBlock(BM::makeID(filename, offset));
+}
+
+// Keeps the page of an internal node pinned for later descents.
+void Tree::keep(Ptr offset, const BM::PtrBlock &blk) const {
+    BM::LatchGuard guard(innerLatch, true);
+    if (inner.size() < INNER_CACHE_SIZE && inner.emplace(offset, blk).second) {
+        blk->pin();
+    }
+}
+
+Ptr Tree::allocate() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (header.freeOffset == NullPtr) {
+        return header.numBlocks++;
+    }
+    // a released node keeps the next free node in its first word
+    Ptr offset = header.freeOffset;
+    BM::PtrBlock blk = BM::readBlock(BM::makeID(filename, offset));
+    std::memcpy(&header.freeOffset, blk->block_data, sizeof(Ptr));
+    return offset;
+}
+
+void Tree::release(Ptr offset) {
+    {
+        BM::LatchGuard guard(innerLatch, true);
+        auto iter = inner.find(offset);
+        if (iter != inner.end()) {
+            iter->second->unpin();
+            inner.erase(iter);
+        }
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    BM::writeBlock(BM::makeID(filename, offset),
+                   reinterpret_cast<const char *>(&header.freeOffset), 0,
+                   sizeof(Ptr));
+    header.freeOffset = offset;
+}
+
+void Tree::writeHeader() {
+    std::lock_guard<std::mutex> lock(mutex);
+    header.rootOffset = root;
+    BM::writeBlock(BM::makeID(filename, 0),
+                   reinterpret_cast<const char *>(&header), 0, sizeof(header));
+}
 
-            delete[] tmpKeys;
-            delete[] tmpChildren;
+void Tree::insert_in_parent(std::vector<Ptr> &path, const Ptr &nodeOffset0,
+                            const Key &key, const Ptr &nodeOffset1) {
+    if (path.empty()) {
+        Node root(keyWidth);
+        root.keys.push_back(key);
+        root.children.push_back(nodeOffset0);
+        root.children.push_back(nodeOffset1);
+        // readers may pick up the new root as soon as it is set
+        Ptr rootOffset = allocate();
+        root.writeToBlock(BM::makeID(filename, rootOffset));
+        this->root = rootOffset;
+        return;
+    }
+    Ptr parentOffset = path.back();
+    path.pop_back();
+    Node parent(keyWidth);
+    parent.readFromBlock(BM::readBlock(BM::makeID(filename, parentOffset)));
+    int i = std::find(parent.children.begin(), parent.children.end(),
+                      nodeOffset0) -
+            parent.children.begin();
+    parent.keys.insert(parent.keys.begin() + i, key);
+    parent.children.insert(parent.children.begin() + i + 1, nodeOffset1);
+    store(path, parentOffset, parent);
+}
 
-            insert_in_parent(parentOffset0, key1, parentOffset1);
+void Tree::remove_entry(std::vector<Ptr> &path, const Ptr &nodeOffset,
+                        Node &node) {
+    if (path.empty()) {
+        // the root may run empty; an internal root with a single child
+        // hands the root over to that child
+        if (node.keys.empty()) {
+            root = node.isLeaf ? NullPtr : node.children[0];
+            release(nodeOffset);
+        } else {
+            node.writeToBlock(BM::makeID(filename, nodeOffset));
         }
+        return;
+    }
+    if (node.size() >= MIN_NODE_SIZE) {
+        node.writeToBlock(BM::makeID(filename, nodeOffset));
+        return;
+    }
+
+    Ptr parentOffset = path.back();
+    path.pop_back();
+    Node parent(keyWidth);
+    parent.readFromBlock(BM::readBlock(BM::makeID(filename, parentOffset)));
+    int idx = std::find(parent.children.begin(), parent.children.end(),
+                        nodeOffset) -
+              parent.children.begin();
+
+    // pair the node with its left sibling, or its right one if it is the
+    // first child; `sep` is the parent key between the two
+    int sep = idx > 0 ? idx - 1 : 0;
+    Ptr siblingOffset = parent.children[idx > 0 ? idx - 1 : 1];
+    Node sibling(keyWidth);
+    sibling.readFromBlock(BM::readBlock(BM::makeID(filename, siblingOffset)));
+    Node &left = idx > 0 ? sibling : node;
+    Node &right = idx > 0 ? node : sibling;
+    Ptr leftOffset = idx > 0 ? siblingOffset : nodeOffset;
+    Ptr rightOffset = idx > 0 ? nodeOffset : siblingOffset;
+
+    Node merged = left;
+    if (!merged.isLeaf) {
+        merged.keys.push_back(parent.keys[sep]);
+    }
+    merged.keys.insert(merged.keys.end(), right.keys.begin(),
+                       right.keys.end());
+    merged.children.insert(merged.children.end(), right.children.begin(),
+                           right.children.end());
+    merged.sibling = right.sibling;
+    if (merged.size() <= NODE_SIZE) {
+        merged.writeToBlock(BM::makeID(filename, leftOffset));
+        release(rightOffset);
+        parent.keys.erase(parent.keys.begin() + sep);
+        parent.children.erase(parent.children.begin() + sep + 1);
+        remove_entry(path, parentOffset, parent);
+        return;
+    }
+
+    // the two do not fit in one node: share their entries out evenly. The
+    // new separator may be longer, and split the parent, or shorter, and
+    // leave the parent to be rebalanced in turn
+    int m = splitPoint(merged);
+    int num0 = merged.isLeaf ? m : m + 1;
+    parent.keys[sep] = merged.isLeaf
+                           ? separator(merged.keys[m - 1], merged.keys[m],
+                                       keyWidth)
+                           : merged.keys[m];
+    left.keys.assign(merged.keys.begin(), merged.keys.begin() + m);
+    right.keys.assign(merged.keys.begin() + num0, merged.keys.end());
+    left.children.assign(merged.children.begin(),
+                         merged.children.begin() + num0);
+    right.children.assign(merged.children.begin() + num0,
+                          merged.children.end());
+    left.writeToBlock(BM::makeID(filename, leftOffset));
+    right.writeToBlock(BM::makeID(filename, rightOffset));
+    if (parent.size() < MIN_NODE_SIZE) {
+        remove_entry(path, parentOffset, parent);
+    } else {
+        store(path, parentOffset, parent);
+    }
+}
+
+std::shared_ptr<Tree> makeTree(ValueType leading, size_t width) {
+    if (width == sizeof(uint32_t)) {
+        return std::make_shared<TypedTree<WordKeys<uint32_t>>>(width);
+    }
+    if (width == sizeof(uint64_t)) {
+        return std::make_shared<TypedTree<WordKeys<uint64_t>>>(width);
+    }
+    if (leading == ValueType::CHAR) {
+        return std::make_shared<TypedTree<CharKeys>>(0);
     }
+    return std::make_shared<TypedTree<ByteKeys>>(0);
 }
 
 } // namespace BPlusTree
 
-} // namespace IM
\ No newline at end of file
+} // namespace IM
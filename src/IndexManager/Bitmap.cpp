@@ -0,0 +1,319 @@
+#include <Error.h>
+#include <FileSpec.h>
+#include <IndexManager/Bitmap.h>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+namespace IM {
+
+namespace Bitmap {
+
+// Words of a bitmap container.
+constexpr size_t NUM_WORDS = 65536 / 64;
+
+bool Container::contains(uint16_t low) const {
+    if (isBitmap()) {
+        return (bits[low >> 6] >> (low & 63)) & 1;
+    }
+    return std::binary_search(array.begin(), array.end(), low);
+}
+
+bool Container::add(uint16_t low) {
+    if (isBitmap()) {
+        uint64_t mask = uint64_t(1) << (low & 63);
+        if (bits[low >> 6] & mask) {
+            return false;
+        }
+        bits[low >> 6] |= mask;
+        count++;
+        return true;
+    }
+    auto iter = std::lower_bound(array.begin(), array.end(), low);
+    if (iter != array.end() && *iter == low) {
+        return false;
+    }
+    array.insert(iter, low);
+    if (++count > ARRAY_MAX) {
+        toBitmap();
+    }
+    return true;
+}
+
+bool Container::remove(uint16_t low) {
+    if (isBitmap()) {
+        uint64_t mask = uint64_t(1) << (low & 63);
+        if (!(bits[low >> 6] & mask)) {
+            return false;
+        }
+        bits[low >> 6] &= ~mask;
+        if (--count <= ARRAY_MAX) {
+            toArray();
+        }
+        return true;
+    }
+    auto iter = std::lower_bound(array.begin(), array.end(), low);
+    if (iter == array.end() || *iter != low) {
+        return false;
+    }
+    array.erase(iter);
+    count--;
+    return true;
+}
+
+void Container::toBitmap() {
+    bits.assign(NUM_WORDS, 0);
+    for (auto low : array) {
+        bits[low >> 6] |= uint64_t(1) << (low & 63);
+    }
+    std::vector<uint16_t>().swap(array);
+}
+
+void Container::toArray() {
+    std::vector<uint16_t> lows;
+    lows.reserve(count);
+    for (size_t i = 0; i < NUM_WORDS; i++) {
+        for (uint64_t word = bits[i]; word != 0; word &= word - 1) {
+            lows.push_back(
+                static_cast<uint16_t>(i * 64 + __builtin_ctzll(word)));
+        }
+    }
+    array.swap(lows);
+    std::vector<uint64_t>().swap(bits);
+}
+
+void Container::intersect(const Container &other) {
+    if (isBitmap() && other.isBitmap()) {
+        count = 0;
+        for (size_t i = 0; i < NUM_WORDS; i++) {
+            bits[i] &= other.bits[i];
+            count += __builtin_popcountll(bits[i]);
+        }
+        if (count <= ARRAY_MAX) {
+            toArray();
+        }
+        return;
+    }
+    // the result fits in an array when either side is one
+    std::vector<uint16_t> lows;
+    if (isBitmap()) {
+        for (auto low : other.array) {
+            if (contains(low)) {
+                lows.push_back(low);
+            }
+        }
+        std::vector<uint64_t>().swap(bits);
+    } else if (other.isBitmap()) {
+        for (auto low : array) {
+            if (other.contains(low)) {
+                lows.push_back(low);
+            }
+        }
+    } else {
+        std::set_intersection(array.begin(), array.end(), other.array.begin(),
+                              other.array.end(), std::back_inserter(lows));
+    }
+    array.swap(lows);
+    count = static_cast<uint32_t>(array.size());
+}
+
+size_t Set::cardinality() const {
+    size_t num = 0;
+    for (auto &container : containers) {
+        num += container.count;
+    }
+    return num;
+}
+
+bool Set::contains(Off offset) const {
+    auto high = static_cast<uint16_t>(offset >> 16);
+    auto iter = std::lower_bound(highs.begin(), highs.end(), high);
+    return iter != highs.end() && *iter == high &&
+           containers[iter - highs.begin()].contains(offset & 0xFFFF);
+}
+
+void Set::add(Off offset) {
+    auto high = static_cast<uint16_t>(offset >> 16);
+    auto iter = std::lower_bound(highs.begin(), highs.end(), high);
+    auto i = iter - highs.begin();
+    if (iter == highs.end() || *iter != high) {
+        highs.insert(iter, high);
+        containers.insert(containers.begin() + i, Container());
+    }
+    containers[i].add(offset & 0xFFFF);
+}
+
+bool Set::remove(Off offset) {
+    auto high = static_cast<uint16_t>(offset >> 16);
+    auto iter = std::lower_bound(highs.begin(), highs.end(), high);
+    auto i = iter - highs.begin();
+    if (iter == highs.end() || *iter != high ||
+        !containers[i].remove(offset & 0xFFFF)) {
+        return false;
+    }
+    if (containers[i].count == 0) {
+        highs.erase(iter);
+        containers.erase(containers.begin() + i);
+    }
+    return true;
+}
+
+void Set::intersect(const Set &other) {
+    size_t kept = 0;
+    size_t j = 0;
+    for (size_t i = 0; i < highs.size(); i++) {
+        while (j < other.highs.size() && other.highs[j] < highs[i]) {
+            j++;
+        }
+        if (j == other.highs.size() || other.highs[j] != highs[i]) {
+            continue;
+        }
+        containers[i].intersect(other.containers[j]);
+        if (containers[i].count > 0) {
+            highs[kept] = highs[i];
+            std::swap(containers[kept], containers[i]);
+            kept++;
+        }
+    }
+    highs.resize(kept);
+    containers.resize(kept);
+}
+
+void Set::offsets(std::vector<Off> &offsets) const {
+    for (size_t i = 0; i < highs.size(); i++) {
+        Off base = static_cast<Off>(highs[i]) << 16;
+        auto &container = containers[i];
+        if (!container.isBitmap()) {
+            for (auto low : container.array) {
+                offsets.push_back(base | low);
+            }
+            continue;
+        }
+        for (size_t w = 0; w < NUM_WORDS; w++) {
+            for (uint64_t word = container.bits[w]; word != 0;
+                 word &= word - 1) {
+                offsets.push_back(base | (w * 64 + __builtin_ctzll(word)));
+            }
+        }
+    }
+}
+
+template <typename T> static void put(std::ostream &os, const T &value) {
+    os.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T> static void get(std::istream &is, T &value) {
+    is.read(reinterpret_cast<char *>(&value), sizeof(T));
+}
+
+void Set::write(std::ostream &os) const {
+    put(os, static_cast<uint32_t>(highs.size()));
+    for (size_t i = 0; i < highs.size(); i++) {
+        auto &container = containers[i];
+        put(os, highs[i]);
+        put(os, container.count);
+        if (container.isBitmap()) {
+            os.write(reinterpret_cast<const char *>(container.bits.data()),
+                     NUM_WORDS * sizeof(uint64_t));
+        } else {
+            os.write(reinterpret_cast<const char *>(container.array.data()),
+                     container.count * sizeof(uint16_t));
+        }
+    }
+}
+
+void Set::read(std::istream &is) {
+    uint32_t num = 0;
+    get(is, num);
+    highs.resize(num);
+    containers.assign(num, Container());
+    for (uint32_t i = 0; i < num && is; i++) {
+        auto &container = containers[i];
+        get(is, highs[i]);
+        get(is, container.count);
+        if (container.count > ARRAY_MAX) {
+            container.bits.resize(NUM_WORDS);
+            is.read(reinterpret_cast<char *>(container.bits.data()),
+                    NUM_WORDS * sizeof(uint64_t));
+        } else {
+            container.array.resize(container.count);
+            is.read(reinterpret_cast<char *>(container.array.data()),
+                    container.count * sizeof(uint16_t));
+        }
+    }
+}
+
+void Index::insert(const Key &key, Off offset) {
+    sets[key].add(offset);
+    dirty = true;
+}
+
+void Index::remove(const Key &key, Off offset) {
+    auto iter = sets.find(key);
+    if (iter == sets.end()) {
+        return;
+    }
+    iter->second.remove(offset);
+    if (iter->second.empty()) {
+        sets.erase(iter);
+    }
+    dirty = true;
+}
+
+const Set *Index::find(const Key &key) const {
+    auto iter = sets.find(key);
+    return iter != sets.end() ? &iter->second : nullptr;
+}
+
+void Index::load() {
+    std::ifstream ifs(filename, std::ios::in | std::ios::binary);
+    if (ifs.fail()) {
+        throw SysError("cannot open file \'" + filename + "\'");
+    }
+    File::bitmapFileHeader header;
+    get(ifs, header);
+    if (!ifs ||
+        header.filetype != static_cast<uint32_t>(File::FileType::BITMAP)) {
+        throw SysError("file type not compatible");
+    }
+    sets.clear();
+    for (uint32_t i = 0; i < header.numKeys && ifs; i++) {
+        uint32_t len = 0;
+        get(ifs, len);
+        Key key(len, '\0');
+        ifs.read(&key[0], len);
+        sets[key].read(ifs);
+    }
+    if (!ifs) {
+        sets.clear();
+        throw SysError("cannot read file \'" + filename + "\'");
+    }
+    dirty = false;
+}
+
+void Index::save() {
+    auto tmpFilename = filename + ".tmp";
+    std::ofstream ofs(tmpFilename, std::ios::out | std::ios::binary);
+    if (ofs.fail()) {
+        throw SysError("cannot create file \'" + tmpFilename + "\'");
+    }
+    File::bitmapFileHeader header;
+    header.filetype = static_cast<uint32_t>(File::FileType::BITMAP);
+    header.numKeys = static_cast<uint32_t>(sets.size());
+    put(ofs, header);
+    for (auto &entry : sets) {
+        put(ofs, static_cast<uint32_t>(entry.first.size()));
+        ofs.write(entry.first.data(), entry.first.size());
+        entry.second.write(ofs);
+    }
+    ofs.close();
+    if (ofs.fail() || std::rename(tmpFilename.c_str(), filename.c_str())) {
+        throw SysError("cannot write file \'" + filename + "\'");
+    }
+    dirty = false;
+}
+
+} // namespace Bitmap
+
+} // namespace IM
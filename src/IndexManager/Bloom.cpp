@@ -0,0 +1,128 @@
+#include <Error.h>
+#include <FileSpec.h>
+#include <IndexManager/Bloom.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace IM {
+
+namespace Bloom {
+
+// Calls `visit` with each bit of a filter of `numBits` bits that stands
+// for the key, until it returns false.
+template <typename Visitor>
+static bool probe(const char *data, size_t len, uint64_t numBits,
+                  Visitor visit) {
+    uint64_t h = 0xCBF29CE484222325ULL; // FNV-1a
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ static_cast<unsigned char>(data[i])) * 0x100000001B3ULL;
+    }
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    h ^= h >> 31;
+    uint32_t h1 = static_cast<uint32_t>(h), h2 = (h >> 32) | 1;
+    for (uint32_t i = 0; i < NUM_PROBES; i++) {
+        if (!visit((h1 + i * h2) % numBits)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+Filter::Filter(const std::vector<size_t> &widths)
+    : widths(widths), capacity(0), numKeys(0) {
+    reset(MIN_CAPACITY);
+}
+
+void Filter::reset(size_t numKeys) {
+    std::lock_guard<std::mutex> lock(mutex);
+    capacity = static_cast<uint32_t>(std::max(numKeys, MIN_CAPACITY));
+    this->numKeys = 0;
+    bits.assign((static_cast<size_t>(capacity) * BITS_PER_KEY + 63) / 64, 0);
+}
+
+size_t Filter::keyLength(const Key &entry) const {
+    size_t len = 0;
+    for (auto width : widths) {
+        if (width != 0) {
+            len += width;
+        } else if ((len = entry.find('\0', len)) == Key::npos) {
+            return entry.size();
+        } else {
+            len++;
+        }
+    }
+    return std::min(len, entry.size());
+}
+
+void Filter::add(const Key &entry) {
+    std::lock_guard<std::mutex> lock(mutex);
+    probe(entry.data(), keyLength(entry), bits.size() * 64, [&](uint64_t bit) {
+        bits[bit / 64] |= uint64_t(1) << (bit % 64);
+        return true;
+    });
+    numKeys++;
+}
+
+bool Filter::mayContain(const Key &key) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return probe(key.data(), key.size(), bits.size() * 64, [&](uint64_t bit) {
+        return ((bits[bit / 64] >> (bit % 64)) & 1) != 0;
+    });
+}
+
+bool Filter::isFull() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return numKeys > capacity;
+}
+
+bool Filter::load() {
+    std::lock_guard<std::mutex> lock(mutex);
+    File::bloomFileHeader header;
+    bool loaded = false;
+    {
+        std::ifstream ifs(filename, std::ios::in | std::ios::binary);
+        ifs.read(reinterpret_cast<char *>(&header), sizeof(header));
+        if (ifs && header.filetype ==
+                       static_cast<uint32_t>(File::FileType::BLOOM)) {
+            std::vector<uint64_t> words(header.numWords);
+            ifs.read(reinterpret_cast<char *>(words.data()),
+                     words.size() * sizeof(uint64_t));
+            if (ifs && !words.empty()) {
+                capacity = header.capacity;
+                numKeys = header.numKeys;
+                bits.swap(words);
+                loaded = true;
+            }
+        }
+    }
+    std::remove(filename.c_str());
+    return loaded;
+}
+
+void Filter::save() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto tmpFilename = filename + ".tmp";
+    std::ofstream ofs(tmpFilename, std::ios::out | std::ios::binary);
+    if (ofs.fail()) {
+        throw SysError("cannot create file \'" + tmpFilename + "\'");
+    }
+    File::bloomFileHeader header;
+    header.filetype = static_cast<uint32_t>(File::FileType::BLOOM);
+    header.capacity = capacity;
+    header.numKeys = numKeys;
+    header.numWords = static_cast<uint32_t>(bits.size());
+    ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    ofs.write(reinterpret_cast<const char *>(bits.data()),
+              bits.size() * sizeof(uint64_t));
+    ofs.close();
+    if (ofs.fail() || std::rename(tmpFilename.c_str(), filename.c_str())) {
+        throw SysError("cannot write file \'" + filename + "\'");
+    }
+}
+
+} // namespace Bloom
+
+} // namespace IM
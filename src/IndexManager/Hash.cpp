@@ -0,0 +1,374 @@
+#include <BufferManager/BufferManager.h>
+#include <Error.h>
+#include <IndexManager/Hash.h>
+#include <algorithm>
+#include <cstring>
+
+namespace IM {
+
+namespace Hash {
+
+// Bucket page layout: the entry count, the local depth and the next
+// overflow page as uint32_t, then the entries, each the hash of its key as
+// uint32_t, the key length as uint16_t, the key and the record offset.
+constexpr size_t PAGE_HEADER = 3 * sizeof(uint32_t);
+constexpr size_t ENTRY_OVERHEAD =
+    sizeof(uint32_t) + sizeof(uint16_t) + sizeof(Off);
+
+// Directory entries per block.
+constexpr uint32_t DIR_ENTRIES = BM::BLOCK_SIZE / sizeof(Ptr);
+
+// FNV-1a, with the high bits mixed down as the directory takes the low.
+static uint32_t hashKey(const Key &key) {
+    uint32_t h = 2166136261u;
+    for (unsigned char c : key) {
+        h ^= c;
+        h *= 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+void Bucket::add(uint32_t hash, const Key &key, Off offset) {
+    hashes.push_back(hash);
+    keys.push_back(key);
+    offsets.push_back(offset);
+}
+
+Ptr Table::bucketAt(uint32_t i) const {
+    auto blk = BM::readBlock(
+        BM::makeID(filename, header.dirOffset + i / DIR_ENTRIES));
+    Ptr ptr;
+    std::memcpy(&ptr, blk->block_data + (i % DIR_ENTRIES) * sizeof(Ptr),
+                sizeof(Ptr));
+    return ptr;
+}
+
+void Table::setBucketAt(uint32_t i, Ptr ptr) {
+    BM::writeBlock(BM::makeID(filename, header.dirOffset + i / DIR_ENTRIES),
+                   reinterpret_cast<const char *>(&ptr),
+                   (i % DIR_ENTRIES) * sizeof(Ptr), sizeof(Ptr));
+}
+
+std::tuple<Off, bool> Table::find(const Key &key) const {
+    std::vector<Off> offsets;
+    findAll(key, offsets);
+    if (offsets.empty()) {
+        return std::make_tuple(NullPtr, false);
+    }
+    return std::make_tuple(offsets[0], true);
+}
+
+void Table::findAll(const Key &key, std::vector<Off> &offsets) const {
+    if (header.dirOffset == NullPtr) {
+        return;
+    }
+    uint32_t hash = hashKey(key);
+    Ptr page = bucketAt(hash & ((1u << header.globalDepth) - 1));
+    // scan the pages in place, looking at keys of matching hash only
+    while (page != NullPtr) {
+        auto blk = BM::readBlock(BM::makeID(filename, page));
+        const char *data = blk->block_data;
+        uint32_t numEntries;
+        std::memcpy(&numEntries, data, sizeof(uint32_t));
+        std::memcpy(&page, data + 2 * sizeof(uint32_t), sizeof(Ptr));
+        size_t pos = PAGE_HEADER;
+        for (uint32_t i = 0; i < numEntries; i++) {
+            uint32_t h;
+            uint16_t len;
+            std::memcpy(&h, data + pos, sizeof(uint32_t));
+            std::memcpy(&len, data + pos + sizeof(uint32_t),
+                        sizeof(uint16_t));
+            const char *bytes = data + pos + sizeof(uint32_t) +
+                                sizeof(uint16_t);
+            if (h == hash && len == key.size() &&
+                std::memcmp(bytes, key.data(), len) == 0) {
+                Off offset;
+                std::memcpy(&offset, bytes + len, sizeof(Off));
+                offsets.push_back(offset);
+            }
+            pos += ENTRY_OVERHEAD + len;
+        }
+    }
+}
+
+bool Table::hasKey(const Key &key) const {
+    return std::get<1>(find(key));
+}
+
+void Table::readPage(Ptr page, Bucket &bucket, Ptr &next) const {
+    auto blk = BM::readBlock(BM::makeID(filename, page));
+    const char *data = blk->block_data;
+    uint32_t numEntries;
+    std::memcpy(&numEntries, data, sizeof(uint32_t));
+    std::memcpy(&bucket.depth, data + sizeof(uint32_t), sizeof(uint32_t));
+    std::memcpy(&next, data + 2 * sizeof(uint32_t), sizeof(Ptr));
+    size_t pos = PAGE_HEADER;
+    for (uint32_t i = 0; i < numEntries; i++) {
+        uint32_t hash;
+        uint16_t len;
+        Off offset;
+        std::memcpy(&hash, data + pos, sizeof(uint32_t));
+        pos += sizeof(uint32_t);
+        std::memcpy(&len, data + pos, sizeof(uint16_t));
+        pos += sizeof(uint16_t);
+        Key key(data + pos, len);
+        pos += len;
+        std::memcpy(&offset, data + pos, sizeof(Off));
+        pos += sizeof(Off);
+        bucket.add(hash, key, offset);
+    }
+}
+
+// Encodes entries [first, last) of a bucket as one page.
+static std::string encodePage(const Bucket &bucket, size_t first,
+                              size_t last, Ptr next) {
+    std::string image(PAGE_HEADER, '\0');
+    uint32_t numEntries = last - first;
+    std::memcpy(&image[0], &numEntries, sizeof(uint32_t));
+    std::memcpy(&image[sizeof(uint32_t)], &bucket.depth, sizeof(uint32_t));
+    std::memcpy(&image[2 * sizeof(uint32_t)], &next, sizeof(Ptr));
+    for (size_t i = first; i < last; i++) {
+        auto &key = bucket.keys[i];
+        uint16_t len = key.size();
+        image.append(reinterpret_cast<const char *>(&bucket.hashes[i]),
+                     sizeof(uint32_t));
+        image.append(reinterpret_cast<const char *>(&len), sizeof(uint16_t));
+        image.append(key);
+        image.append(reinterpret_cast<const char *>(&bucket.offsets[i]),
+                     sizeof(Off));
+    }
+    return image;
+}
+
+static size_t pageSize(const Bucket &bucket) {
+    size_t size = PAGE_HEADER;
+    for (auto &key : bucket.keys) {
+        size += ENTRY_OVERHEAD + key.size();
+    }
+    return size;
+}
+
+void Table::writePage(Ptr page, const Bucket &bucket, Ptr next) {
+    auto image = encodePage(bucket, 0, bucket.keys.size(), next);
+    BM::writeBlock(BM::makeID(filename, page), image.data(), 0, image.size());
+}
+
+Bucket Table::readChain(Ptr page, std::vector<Ptr> &pages) const {
+    Bucket bucket;
+    while (page != NullPtr) {
+        pages.push_back(page);
+        readPage(page, bucket, page);
+    }
+    return bucket;
+}
+
+// Writes a bucket over the given pages, taking more for overflow when it
+// does not fit in them and releasing those it no longer needs. The first
+// page stays the one the directory points at.
+void Table::writeChain(std::vector<Ptr> &pages, const Bucket &bucket) {
+    std::vector<size_t> firsts(1, 0);
+    size_t used = PAGE_HEADER;
+    for (size_t i = 0; i < bucket.keys.size(); i++) {
+        size_t size = ENTRY_OVERHEAD + bucket.keys[i].size();
+        if (used + size > BM::BLOCK_SIZE) {
+            firsts.push_back(i);
+            used = PAGE_HEADER;
+        }
+        used += size;
+    }
+    firsts.push_back(bucket.keys.size());
+    size_t numPages = firsts.size() - 1;
+    while (pages.size() < numPages) {
+        pages.push_back(allocate());
+    }
+    while (pages.size() > numPages) {
+        release(pages.back());
+        pages.pop_back();
+    }
+    for (size_t i = 0; i < numPages; i++) {
+        Ptr next = i + 1 < numPages ? pages[i + 1] : NullPtr;
+        auto image = encodePage(bucket, firsts[i], firsts[i + 1], next);
+        BM::writeBlock(BM::makeID(filename, pages[i]), image.data(), 0,
+                       image.size());
+    }
+}
+
+// Doubles the directory into fresh consecutive blocks, each new entry
+// pointing where the entry sharing its low bits did.
+void Table::grow() {
+    uint32_t num = 1u << header.globalDepth;
+    std::vector<Ptr> entries(2 * num);
+    for (uint32_t i = 0; i < num; i++) {
+        entries[i] = entries[i + num] = bucketAt(i);
+    }
+    uint32_t oldBlocks = (num + DIR_ENTRIES - 1) / DIR_ENTRIES;
+    uint32_t newBlocks = (2 * num + DIR_ENTRIES - 1) / DIR_ENTRIES;
+    for (uint32_t i = 0; i < oldBlocks; i++) {
+        release(header.dirOffset + i);
+    }
+    header.dirOffset = header.numBlocks;
+    header.numBlocks += newBlocks;
+    header.globalDepth++;
+    for (uint32_t i = 0; i < newBlocks; i++) {
+        uint32_t first = i * DIR_ENTRIES;
+        uint32_t count = std::min(DIR_ENTRIES, 2 * num - first);
+        BM::writeBlock(BM::makeID(filename, header.dirOffset + i),
+                       reinterpret_cast<const char *>(&entries[first]), 0,
+                       count * sizeof(Ptr));
+    }
+}
+
+void Table::insert(const Key &key, const Off &offset) {
+    if (PAGE_HEADER + ENTRY_OVERHEAD + key.size() > BM::BLOCK_SIZE) {
+        throw SysError("index key too long");
+    }
+    uint32_t hash = hashKey(key);
+    if (header.dirOffset == NullPtr) {
+        std::vector<Ptr> pages;
+        header.dirOffset = header.numBlocks++;
+        Bucket bucket;
+        bucket.add(hash, key, offset);
+        writeChain(pages, bucket);
+        setBucketAt(0, pages[0]);
+        writeHeader();
+        return;
+    }
+    uint32_t i = hash & ((1u << header.globalDepth) - 1);
+    Ptr head = bucketAt(i);
+    if (unique) {
+        std::vector<Ptr> pages;
+        Bucket bucket = readChain(head, pages);
+        auto iter = std::find(bucket.keys.begin(), bucket.keys.end(), key);
+        if (iter != bucket.keys.end()) {
+            bucket.offsets[iter - bucket.keys.begin()] = offset;
+            writeChain(pages, bucket);
+            return;
+        }
+    }
+
+    // new entries go to the first page of the bucket
+    Bucket page;
+    Ptr next;
+    readPage(head, page, next);
+    if (pageSize(page) + ENTRY_OVERHEAD + key.size() <= BM::BLOCK_SIZE) {
+        page.add(hash, key, offset);
+        writePage(head, page, next);
+        return;
+    }
+    // a full page of keys that all hash alike cannot be split: its
+    // entries move to a new overflow page and the first page starts over
+    bool sameHash = std::all_of(page.hashes.begin(), page.hashes.end(),
+                                [&](uint32_t h) -> bool { return h == hash; });
+    if (sameHash || page.depth >= MAX_DEPTH) {
+        Ptr overflow = allocate();
+        writePage(overflow, page, next);
+        Bucket fresh;
+        fresh.depth = page.depth;
+        fresh.add(hash, key, offset);
+        writePage(head, fresh, overflow);
+        writeHeader();
+        return;
+    }
+
+    // split by the next hash bit; one half may still overflow, and splits
+    // again on a later insert
+    std::vector<Ptr> pages;
+    Bucket bucket = readChain(head, pages);
+    bucket.add(hash, key, offset);
+    uint32_t depth = bucket.depth;
+    if (depth == header.globalDepth) {
+        grow();
+    }
+    Bucket bucket0, bucket1;
+    bucket0.depth = bucket1.depth = depth + 1;
+    for (size_t j = 0; j < bucket.keys.size(); j++) {
+        auto &half = (bucket.hashes[j] >> depth) & 1 ? bucket1 : bucket0;
+        half.add(bucket.hashes[j], bucket.keys[j], bucket.offsets[j]);
+    }
+    std::vector<Ptr> pages1;
+    writeChain(pages, bucket0);
+    writeChain(pages1, bucket1);
+    uint32_t low = (i & ((1u << depth) - 1)) | (1u << depth);
+    for (uint32_t j = low; j < (1u << header.globalDepth);
+         j += 1u << (depth + 1)) {
+        setBucketAt(j, pages1[0]);
+    }
+    writeHeader();
+}
+
+// Buckets are not merged back. An emptied overflow page is unlinked and
+// released; an emptied first page takes over the page after it.
+void Table::remove(const Key &key, const Off &offset) {
+    if (header.dirOffset == NullPtr) {
+        return;
+    }
+    uint32_t hash = hashKey(key);
+    Ptr head = bucketAt(hash & ((1u << header.globalDepth) - 1));
+    Ptr prev = NullPtr, next;
+    for (Ptr page = head; page != NullPtr; prev = page, page = next) {
+        Bucket bucket;
+        readPage(page, bucket, next);
+        size_t j = 0;
+        while (j < bucket.keys.size() &&
+               !(bucket.hashes[j] == hash && bucket.keys[j] == key &&
+                 (unique || bucket.offsets[j] == offset))) {
+            j++;
+        }
+        if (j == bucket.keys.size()) {
+            continue;
+        }
+        bucket.hashes.erase(bucket.hashes.begin() + j);
+        bucket.keys.erase(bucket.keys.begin() + j);
+        bucket.offsets.erase(bucket.offsets.begin() + j);
+        if (!bucket.keys.empty() || (page == head && next == NullPtr)) {
+            writePage(page, bucket, next);
+            return;
+        }
+        if (page == head) {
+            Bucket following;
+            Ptr after;
+            readPage(next, following, after);
+            writePage(head, following, after);
+            release(next);
+        } else {
+            BM::writeBlock(BM::makeID(filename, prev),
+                           reinterpret_cast<const char *>(&next),
+                           2 * sizeof(uint32_t), sizeof(Ptr));
+            release(page);
+        }
+        writeHeader();
+        return;
+    }
+}
+
+Ptr Table::allocate() {
+    if (header.freeOffset == NullPtr) {
+        return header.numBlocks++;
+    }
+    // a released page keeps the next free page in its first word
+    Ptr offset = header.freeOffset;
+    BM::PtrBlock blk = BM::readBlock(BM::makeID(filename, offset));
+    std::memcpy(&header.freeOffset, blk->block_data, sizeof(Ptr));
+    return offset;
+}
+
+void Table::release(Ptr offset) {
+    BM::writeBlock(BM::makeID(filename, offset),
+                   reinterpret_cast<const char *>(&header.freeOffset), 0,
+                   sizeof(Ptr));
+    header.freeOffset = offset;
+}
+
+void Table::writeHeader() {
+    BM::writeBlock(BM::makeID(filename, 0),
+                   reinterpret_cast<const char *>(&header), 0, sizeof(header));
+}
+
+} // namespace Hash
+
+} // namespace IM
@@ -0,0 +1,184 @@
+#include <CatalogManager/CatalogManager.h>
+#include <Error.h>
+#include <FileSpec.h>
+#include <IndexManager/IndexBuilder.h>
+#include <IndexManager/IndexManager.h>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+namespace IM {
+
+using Entry = std::pair<BPlusTree::Key, BPlusTree::Off>;
+
+static bool entryLess(const Entry &lhs, const Entry &rhs) {
+    if (lhs.first != rhs.first) {
+        return lhs.first < rhs.first;
+    }
+    return lhs.second < rhs.second;
+}
+
+// Each entry of a run file is the key length, the key and the offset.
+static void writeEntry(std::ofstream &ofs, const Entry &entry) {
+    uint16_t len = entry.first.size();
+    ofs.write(reinterpret_cast<const char *>(&len), sizeof(uint16_t));
+    ofs.write(entry.first.data(), len);
+    ofs.write(reinterpret_cast<const char *>(&entry.second),
+              sizeof(BPlusTree::Off));
+}
+
+static bool readEntry(std::ifstream &ifs, Entry &entry) {
+    uint16_t len = 0;
+    ifs.read(reinterpret_cast<char *>(&len), sizeof(uint16_t));
+    entry.first.resize(len);
+    ifs.read(&entry.first[0], len);
+    ifs.read(reinterpret_cast<char *>(&entry.second), sizeof(BPlusTree::Off));
+    return static_cast<bool>(ifs);
+}
+
+// Reads back the entries of sorted run files in order.
+class RunMerger {
+  public:
+    explicit RunMerger(const std::vector<std::string> &filenames)
+        : readers(filenames.size()), heads(filenames.size()) {
+        for (size_t i = 0; i < filenames.size(); i++) {
+            readers[i].open(filenames[i], std::ios::in | std::ios::binary);
+            if (readEntry(readers[i], heads[i])) {
+                heap.push_back(i);
+            }
+        }
+        std::make_heap(heap.begin(), heap.end(), Greater{heads});
+    }
+
+    bool next(Entry &entry) {
+        if (heap.empty()) {
+            return false;
+        }
+        std::pop_heap(heap.begin(), heap.end(), Greater{heads});
+        size_t i = heap.back();
+        entry = heads[i];
+        if (readEntry(readers[i], heads[i])) {
+            std::push_heap(heap.begin(), heap.end(), Greater{heads});
+        } else {
+            heap.pop_back();
+        }
+        return true;
+    }
+
+  private:
+    struct Greater {
+        const std::vector<Entry> &heads;
+        bool operator()(size_t lhs, size_t rhs) const {
+            return entryLess(heads[rhs], heads[lhs]);
+        }
+    };
+    std::vector<std::ifstream> readers;
+    std::vector<Entry> heads;
+    std::vector<size_t> heap;
+};
+
+IndexBuilder::IndexBuilder(const std::string &indexName, double fillFactor)
+    : indexName(indexName), fillFactor(fillFactor),
+      index(CM::mapIndices.at(indexName)), tree(openTree(indexName)),
+      runBytes(0), numRuns(0), numEntries(0) {}
+
+IndexBuilder::~IndexBuilder() {
+    for (auto &filename : runFiles) {
+        std::remove(filename.c_str());
+    }
+}
+
+void IndexBuilder::add(const std::vector<Value> &values,
+                       const uint32_t offset) {
+    run.emplace_back(treeKey(index, values, offset), offset);
+    runBytes += sizeof(Entry) + run.back().first.size();
+    numEntries++;
+    if (runBytes >= RUN_BYTES) {
+        spill();
+    }
+}
+
+void IndexBuilder::spill() {
+    if (runFiles.size() == MERGE_WIDTH) {
+        mergeRuns();
+    }
+    std::sort(run.begin(), run.end(), entryLess);
+    auto filename = File::runFilename(indexName, numRuns++);
+    std::ofstream ofs(filename, std::ios::out | std::ios::binary);
+    if (ofs.fail()) {
+        throw SysError("cannot create file \'" + filename + "\'");
+    }
+    runFiles.push_back(filename);
+    for (auto &entry : run) {
+        writeEntry(ofs, entry);
+    }
+    run.clear();
+    runBytes = 0;
+}
+
+void IndexBuilder::mergeRuns() {
+    auto filename = File::runFilename(indexName, numRuns++);
+    {
+        std::ofstream ofs(filename, std::ios::out | std::ios::binary);
+        if (ofs.fail()) {
+            throw SysError("cannot create file \'" + filename + "\'");
+        }
+        RunMerger merger(runFiles);
+        Entry entry;
+        while (merger.next(entry)) {
+            writeEntry(ofs, entry);
+        }
+    }
+    for (auto &runFile : runFiles) {
+        std::remove(runFile.c_str());
+    }
+    runFiles.assign(1, filename);
+}
+
+void IndexBuilder::build() {
+    std::function<bool(Entry &)> pull;
+    size_t pos = 0;
+    std::unique_ptr<RunMerger> merger;
+
+    if (runFiles.empty()) {
+        std::sort(run.begin(), run.end(), entryLess);
+        pull = [&](Entry &entry) {
+            if (pos == run.size()) {
+                return false;
+            }
+            entry = run[pos++];
+            return true;
+        };
+    } else {
+        if (!run.empty()) {
+            spill();
+        }
+        merger.reset(new RunMerger(runFiles));
+        pull = [&](Entry &entry) { return merger->next(entry); };
+    }
+
+    auto bloom = openBloom(indexName);
+    bloom->reset(numEntries);
+
+    // equal keys keep the offset inserted last, as Tree::insert would
+    Entry curr, ahead;
+    bool hasAhead = pull(ahead);
+    tree->bulkLoad(
+        [&](BPlusTree::Key &key, BPlusTree::Off &offset) {
+            if (!hasAhead) {
+                return false;
+            }
+            curr = ahead;
+            while ((hasAhead = pull(ahead)) && ahead.first == curr.first) {
+                curr = ahead;
+            }
+            key = curr.first;
+            offset = curr.second;
+            bloom->add(key);
+            return true;
+        },
+        fillFactor);
+    run.clear();
+}
+
+} // namespace IM
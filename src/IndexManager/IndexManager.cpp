@@ -3,32 +3,312 @@
 #include <Error.h>
 #include <FileSpec.h>
 #include <IndexManager/IndexManager.h>
+#include <IndexManager/Key.h>
+#include <RecordManager/RecordManager.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 
 namespace IM {
 
+// Inserts into a buffered index that are not in its tree yet.
+struct Delta {
+    std::mutex mutex;
+    std::map<BPlusTree::Key, BPlusTree::Off> entries;
+};
+
+static std::unordered_map<std::string, std::shared_ptr<BPlusTree::Tree>> trees;
+static std::unordered_map<std::string, std::shared_ptr<Hash::Table>> tables;
+static std::unordered_map<std::string, std::shared_ptr<Delta>> deltas;
+static std::unordered_map<std::string, std::shared_ptr<ART::Tree>> arts;
+static std::unordered_map<std::string, std::shared_ptr<Bitmap::Index>> bitmaps;
+static std::unordered_map<std::string, std::shared_ptr<Bloom::Filter>> blooms;
+static std::mutex mutex; // guards the maps of open indexes
+
+// Length shared by every entry of a tree, or 0 if a CHAR attribute makes
+// the lengths vary.
+static size_t entryWidth(const Index &index) {
+    auto schema = CM::getSchema(index.tableName);
+    size_t width = index.isUnique ? 0 : sizeof(uint32_t);
+    for (auto &attrName : index.columns()) {
+        for (auto &attribute : schema->attributes) {
+            if (attribute.name != attrName) {
+                continue;
+            } else if (attribute.type == ValueType::CHAR) {
+                return 0;
+            }
+            width += encodedWidth(attribute.type, attribute.charCnt);
+        }
+    }
+    return width;
+}
+
+static ValueType leadingType(const Index &index) {
+    auto schema = CM::getSchema(index.tableName);
+    for (auto &attribute : schema->attributes) {
+        if (attribute.name == index.attrNames.front()) {
+            return attribute.type;
+        }
+    }
+    throw SysError("missing attribute \'" + index.attrNames.front() + "\'");
+}
+
+std::shared_ptr<BPlusTree::Tree> openTree(const std::string &indexName) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto iter = trees.find(indexName);
+    if (iter != trees.end()) {
+        return iter->second;
+    }
+    auto &index = CM::mapIndices.at(indexName);
+    auto tree = BPlusTree::makeTree(leadingType(index), entryWidth(index));
+    tree->filename = File::indexFilename(indexName);
+    BM::PtrBlock blk0 = BM::readBlock(BM::makeID(tree->filename, 0));
+    std::memcpy(&tree->header, blk0->block_data, sizeof(tree->header));
+    if (tree->header.filetype != static_cast<uint32_t>(File::FileType::INDEX)) {
+        throw SysError("file type not compatible");
+    }
+    if (tree->header.version != File::INDEX_VERSION) {
+        throw SysError("file \'" + tree->filename +
+                       "\' has an older layout; recreate the index");
+    }
+    tree->root = tree->header.rootOffset;
+    trees[indexName] = tree;
+    return tree;
+}
+
+std::shared_ptr<Hash::Table> openTable(const std::string &indexName) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto iter = tables.find(indexName);
+    if (iter != tables.end()) {
+        return iter->second;
+    }
+    auto table = std::make_shared<Hash::Table>();
+    table->filename = File::indexFilename(indexName);
+    BM::PtrBlock blk0 = BM::readBlock(BM::makeID(table->filename, 0));
+    std::memcpy(&table->header, blk0->block_data, sizeof(table->header));
+    if (table->header.filetype != static_cast<uint32_t>(File::FileType::HASH)) {
+        throw SysError("file type not compatible");
+    }
+    table->unique = CM::mapIndices.at(indexName).isUnique;
+    tables[indexName] = table;
+    return table;
+}
+
+static bool isHash(const std::string &indexName) {
+    return CM::mapIndices.at(indexName).type == IndexType::HASH;
+}
+
+static bool isBuffered(const std::string &indexName) {
+    return CM::mapIndices.at(indexName).type == IndexType::BUFFERED;
+}
+
+static bool isArt(const std::string &indexName) {
+    return CM::mapIndices.at(indexName).type == IndexType::ART;
+}
+
+static bool isBitmap(const std::string &indexName) {
+    return CM::mapIndices.at(indexName).type == IndexType::BITMAP;
+}
+
+static std::shared_ptr<Bitmap::Index>
+openBitmap(const std::string &indexName) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto iter = bitmaps.find(indexName);
+    if (iter != bitmaps.end()) {
+        return iter->second;
+    }
+    auto bitmap = std::make_shared<Bitmap::Index>();
+    bitmap->filename = File::indexFilename(indexName);
+    bitmap->load();
+    bitmaps[indexName] = bitmap;
+    return bitmap;
+}
+
+static std::shared_ptr<ART::Tree> openArt(const std::string &indexName) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto iter = arts.find(indexName);
+    if (iter == arts.end()) {
+        throw SysError("missing data for index \'" + indexName + "\'");
+    }
+    return iter->second;
+}
+
+static std::shared_ptr<Delta> openDelta(const std::string &indexName) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &delta = deltas[indexName];
+    if (!delta) {
+        delta = std::make_shared<Delta>();
+    }
+    return delta;
+}
+
+// Adds the buffered inserts to the tree in one sorted batch. The caller
+// holds the delta's mutex.
+static void merge(const std::string &indexName, Delta &delta) {
+    if (delta.entries.empty()) {
+        return;
+    }
+    std::vector<std::pair<BPlusTree::Key, BPlusTree::Off>> batch(
+        delta.entries.begin(), delta.entries.end());
+    openTree(indexName)->insertBatch(batch);
+    delta.entries.clear();
+}
+
+// Brings the tree of a buffered index up to date before it is scanned.
+static void merge(const std::string &indexName) {
+    if (isBuffered(indexName)) {
+        auto delta = openDelta(indexName);
+        std::lock_guard<std::mutex> lock(delta->mutex);
+        merge(indexName, *delta);
+    }
+}
+
+// Sizes the filter of an index for twice the entries of its tree and adds
+// them.
+static void fill(const std::string &indexName, Bloom::Filter &bloom) {
+    merge(indexName);
+    auto tree = openTree(indexName);
+    auto cursor = tree->seek(nullptr, false, nullptr, false);
+    std::vector<uint32_t> offsets;
+    std::vector<BPlusTree::Key> keys;
+    while (cursor.next(offsets, SCAN_BATCH, &keys)) {
+    }
+    bloom.reset(2 * keys.size());
+    for (auto &key : keys) {
+        bloom.add(key);
+    }
+}
+
+std::shared_ptr<Bloom::Filter> openBloom(const std::string &indexName) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto iter = blooms.find(indexName);
+        if (iter != blooms.end()) {
+            return iter->second;
+        }
+    }
+    auto &index = CM::mapIndices.at(indexName);
+    auto schema = CM::getSchema(index.tableName);
+    std::vector<size_t> widths;
+    for (auto &attrName : index.attrNames) {
+        for (auto &attribute : schema->attributes) {
+            if (attribute.name != attrName) {
+                continue;
+            }
+            widths.push_back(attribute.type == ValueType::CHAR
+                                 ? 0
+                                 : encodedWidth(attribute.type, 0));
+        }
+    }
+    auto bloom = std::make_shared<Bloom::Filter>(widths);
+    bloom->filename = File::bloomFilename(indexName);
+    if (!bloom->load()) {
+        fill(indexName, *bloom);
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &entry = blooms[indexName];
+    if (!entry) {
+        entry = bloom;
+    }
+    return entry;
+}
+
+// Whether the entries of a tree are exactly the encoded key attributes, so
+// that a key is looked up with a single find rather than a scan.
+static bool hasPlainKeys(const std::string &indexName) {
+    auto &index = CM::mapIndices.at(indexName);
+    return index.isUnique && index.includeNames.empty();
+}
+
+BPlusTree::Key treeKey(const Index &index, const std::vector<Value> &values,
+                       const uint32_t offset) {
+    auto numAttrs = index.attrNames.size();
+    BPlusTree::Key key;
+    for (size_t i = 0; i < numAttrs; i++) {
+        encodeValue(key, values[i]);
+    }
+    if (!index.isUnique) {
+        encodeOffset(key, offset);
+    }
+    for (size_t i = numAttrs; i < values.size(); i++) {
+        encodeExactValue(key, values[i]);
+    }
+    return key;
+}
+
+static File::FileType fileType(const std::string &indexName) {
+    return isHash(indexName) ? File::FileType::HASH : File::FileType::INDEX;
+}
+
+// Fills an art index from the records of its table, in place of any tree
+// it had.
+static void build(const std::string &indexName) {
+    auto &index = CM::mapIndices.at(indexName);
+    auto tree = std::make_shared<ART::Tree>();
+    RM::scanRecords(CM::getSchema(index.tableName), index.attrNames,
+                    [&](uint32_t offset, const Record &record) {
+                        tree->insert(treeKey(index, record, offset), offset);
+                    });
+    std::lock_guard<std::mutex> lock(mutex);
+    arts[indexName] = tree;
+}
+
 void init() {
     auto &indices = CM::mapIndices;
     for (auto &index : indices) {
-        if (!hasIndex(index.first)) {
+        if (index.second.type == IndexType::ART) {
+            build(index.first);
+        } else if (!hasIndex(index.first)) {
             throw SysError("missing data for index \'" + index.first + "\'");
         }
     }
 }
 
 bool hasIndex(const std::string &indexName) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (arts.find(indexName) != arts.end()) {
+            return true;
+        }
+    }
     return BM::fileExists(File::indexFilename(indexName));
 }
 
 void createIndex(const std::string &indexName, const std::string &tableName,
-                 const std::string &attrName) {
-    if (!hasIndex(indexName)) {
-        BM::createFile(File::indexFilename(indexName), File::FileType::INDEX);
-    } else {
+                 const std::vector<std::string> &attrNames) {
+    if (isArt(indexName)) {
+        build(indexName);
+    } else if (hasIndex(indexName)) {
         throw Warning("file for index \'" + indexName + "\' already exists");
+    } else if (isBitmap(indexName)) {
+        auto bitmap = std::make_shared<Bitmap::Index>();
+        bitmap->filename = File::indexFilename(indexName);
+        bitmap->save();
+        std::lock_guard<std::mutex> lock(mutex);
+        bitmaps[indexName] = bitmap;
+    } else {
+        BM::createFile(File::indexFilename(indexName), fileType(indexName));
     }
 }
 
 void dropIndex(const std::string &indexName) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        trees.erase(indexName);
+        tables.erase(indexName);
+        deltas.erase(indexName);
+        bitmaps.erase(indexName);
+        blooms.erase(indexName);
+        // the catalog has forgotten the type by now
+        if (arts.erase(indexName) > 0) {
+            return;
+        }
+    }
+    std::remove(File::bloomFilename(indexName).c_str());
     if (hasIndex(indexName)) {
         BM::deleteFile(File::indexFilename(indexName));
     } else {
@@ -36,8 +316,435 @@ void dropIndex(const std::string &indexName) {
     }
 }
 
+void clearIndex(const std::string &indexName) {
+    if (isArt(indexName)) {
+        openArt(indexName)->clear();
+        return;
+    }
+    if (isBitmap(indexName)) {
+        auto bitmap = openBitmap(indexName);
+        bitmap->sets.clear();
+        bitmap->dirty = true;
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        trees.erase(indexName);
+        tables.erase(indexName);
+        deltas.erase(indexName);
+        blooms.erase(indexName);
+    }
+    std::remove(File::bloomFilename(indexName).c_str());
+    BM::deleteFile(File::indexFilename(indexName));
+    BM::createFile(File::indexFilename(indexName), fileType(indexName));
+}
+
+void insertKey(const std::string &indexName, const std::vector<Value> &values,
+               const uint32_t offset) {
+    if (isHash(indexName)) {
+        openTable(indexName)->insert(encodeKey(values), offset);
+        return;
+    } else if (isBitmap(indexName)) {
+        openBitmap(indexName)->insert(encodeKey(values), offset);
+        return;
+    }
+    auto &index = CM::mapIndices.at(indexName);
+    auto key = treeKey(index, values, offset);
+    if (isArt(indexName)) {
+        openArt(indexName)->insert(key, offset);
+        return;
+    }
+    auto bloom = openBloom(indexName);
+    if (bloom->isFull()) {
+        fill(indexName, *bloom);
+    }
+    bloom->add(key);
+    if (isBuffered(indexName)) {
+        auto delta = openDelta(indexName);
+        std::lock_guard<std::mutex> lock(delta->mutex);
+        delta->entries[key] = offset;
+        if (delta->entries.size() >= DELTA_SIZE) {
+            merge(indexName, *delta);
+        }
+        return;
+    }
+    openTree(indexName)->insert(key, offset);
+}
+
+void removeKey(const std::string &indexName, const std::vector<Value> &values,
+               const uint32_t offset) {
+    if (isHash(indexName)) {
+        openTable(indexName)->remove(encodeKey(values), offset);
+        return;
+    } else if (isBitmap(indexName)) {
+        openBitmap(indexName)->remove(encodeKey(values), offset);
+        return;
+    }
+    auto &index = CM::mapIndices.at(indexName);
+    auto key = treeKey(index, values, offset);
+    if (isArt(indexName)) {
+        openArt(indexName)->remove(key);
+        return;
+    }
+    if (isBuffered(indexName)) {
+        auto delta = openDelta(indexName);
+        std::lock_guard<std::mutex> lock(delta->mutex);
+        if (delta->entries.erase(key) > 0) {
+            return;
+        }
+    }
+    openTree(indexName)->remove(key);
+}
+
+bool hasKey(const std::string &indexName, const std::vector<Value> &values) {
+    auto key = encodeKey(values);
+    if (isHash(indexName)) {
+        return openTable(indexName)->hasKey(key);
+    } else if (isBitmap(indexName)) {
+        return openBitmap(indexName)->find(key) != nullptr;
+    }
+    if (isArt(indexName)) {
+        auto tree = openArt(indexName);
+        if (hasPlainKeys(indexName)) {
+            ART::Off offset;
+            return tree->find(key, offset);
+        }
+        bool found = false;
+        tree->scan(&key, true, &key, true, [&](ART::Off) {
+            found = true;
+            return false;
+        });
+        return found;
+    }
+    // a key of fewer than all of the attributes is not in the filter
+    auto &index = CM::mapIndices.at(indexName);
+    if (values.size() == index.attrNames.size() &&
+        !openBloom(indexName)->mayContain(key)) {
+        return false;
+    }
+    if (isBuffered(indexName)) {
+        // entries of the key start with it
+        auto delta = openDelta(indexName);
+        std::lock_guard<std::mutex> lock(delta->mutex);
+        auto iter = delta->entries.lower_bound(key);
+        if (iter != delta->entries.end() &&
+            iter->first.compare(0, key.size(), key) == 0) {
+            return true;
+        }
+    }
+    auto tree = openTree(indexName);
+    if (hasPlainKeys(indexName)) {
+        return tree->hasKey(key);
+    }
+    std::vector<uint32_t> offsets;
+    auto cursor = tree->seek(&key, true, &key, true);
+    cursor.next(offsets, 1);
+    return !offsets.empty();
+}
+
+// Folds the predicates on an indexed attribute into a single interval of
+// encoded values, compared byte by byte as the tree orders them. Returns
+// false if no key can satisfy all of them.
+static bool fold(const std::vector<Predicate> &predicates,
+                 std::vector<BPlusTree::Key> &vals, const BPlusTree::Key *&lo,
+                 bool &loInclusive, const BPlusTree::Key *&hi,
+                 bool &hiInclusive) {
+    lo = hi = nullptr;
+    loInclusive = hiInclusive = false;
+    vals.assign(predicates.size(), BPlusTree::Key());
+    auto raiseLo = [&](const BPlusTree::Key &val, bool inclusive) {
+        int result = lo == nullptr ? 1 : val.compare(*lo);
+        if (result > 0 || (result == 0 && !inclusive)) {
+            lo = &val;
+            loInclusive = inclusive;
+        }
+    };
+    auto lowerHi = [&](const BPlusTree::Key &val, bool inclusive) {
+        int result = hi == nullptr ? -1 : val.compare(*hi);
+        if (result < 0 || (result == 0 && !inclusive)) {
+            hi = &val;
+            hiInclusive = inclusive;
+        }
+    };
+    for (size_t i = 0; i < predicates.size(); i++) {
+        auto &val = vals[i];
+        encodeValue(val, predicates[i].val);
+        switch (predicates[i].op) {
+        case OpType::EQ:
+            raiseLo(val, true);
+            lowerHi(val, true);
+            break;
+        case OpType::LT:
+            lowerHi(val, false);
+            break;
+        case OpType::LEQ:
+            lowerHi(val, true);
+            break;
+        case OpType::GT:
+            raiseLo(val, false);
+            break;
+        case OpType::GEQ:
+            raiseLo(val, true);
+            break;
+        case OpType::NE:
+            break;
+        }
+    }
+    if (lo == nullptr || hi == nullptr) {
+        return true;
+    }
+    int result = lo->compare(*hi);
+    return !(result > 0 || (result == 0 && !(loInclusive && hiInclusive)));
+}
+
+// Key bounds of a scan over an index. Equalities on the leading attributes
+// make up a prefix shared by both bounds, and the predicates on the next
+// attribute extend them into a range. Bounds covering only some of the
+// attributes match every key starting with them.
+struct Bounds {
+    BPlusTree::Key lo, hi;
+    bool hasLo = false, loInclusive = true;
+    bool hasHi = false, hiInclusive = true;
+    bool exact = false; // every attribute is fixed by an equality
+};
+
+// Returns false if no key can satisfy all of the predicates.
+static bool makeBounds(const std::string &indexName,
+                       const std::vector<Predicate> &predicates,
+                       Bounds &bounds) {
+    auto &attrNames = CM::mapIndices.at(indexName).attrNames;
+    BPlusTree::Key prefix;
+    for (auto &attrName : attrNames) {
+        std::vector<Predicate> attrPredicates;
+        for (auto &predicate : predicates) {
+            if (predicate.attrName == attrName) {
+                attrPredicates.push_back(predicate);
+            }
+        }
+        std::vector<BPlusTree::Key> vals;
+        const BPlusTree::Key *lo, *hi;
+        bool loInclusive, hiInclusive;
+        if (!fold(attrPredicates, vals, lo, loInclusive, hi, hiInclusive)) {
+            return false;
+        }
+        if (lo != nullptr && hi != nullptr && *lo == *hi) {
+            prefix += *lo;
+            continue;
+        }
+        bounds.lo = bounds.hi = prefix;
+        if (lo != nullptr) {
+            bounds.lo += *lo;
+            bounds.loInclusive = loInclusive;
+        }
+        if (hi != nullptr) {
+            bounds.hi += *hi;
+            bounds.hiInclusive = hiInclusive;
+        }
+        bounds.hasLo = !bounds.lo.empty();
+        bounds.hasHi = !bounds.hi.empty();
+        return true;
+    }
+    bounds.lo = bounds.hi = prefix;
+    bounds.hasLo = bounds.hasHi = bounds.exact = true;
+    return true;
+}
+
+BPlusTree::Cursor seek(const std::string &indexName,
+                       const std::vector<Predicate> &predicates) {
+    if (isHash(indexName)) {
+        throw SysError("hash index \'" + indexName + "\' cannot be scanned");
+    }
+    if (isArt(indexName)) {
+        throw SysError("art index \'" + indexName + "\' has no cursor");
+    }
+    if (isBitmap(indexName)) {
+        throw SysError("bitmap index \'" + indexName +
+                       "\' cannot be scanned");
+    }
+    Bounds bounds;
+    merge(indexName);
+    auto tree = openTree(indexName);
+    if (!makeBounds(indexName, predicates, bounds)) {
+        BPlusTree::Cursor cursor(*tree, nullptr, false, nullptr, false);
+        cursor.leaf = BPlusTree::NullPtr;
+        return cursor;
+    }
+    return tree->seek(bounds.hasLo ? &bounds.lo : nullptr, bounds.loInclusive,
+                      bounds.hasHi ? &bounds.hi : nullptr,
+                      bounds.hiInclusive);
+}
+
+std::vector<uint32_t> search(const std::string &indexName,
+                             const std::vector<Predicate> &predicates) {
+    Bounds bounds;
+    std::vector<uint32_t> offsets;
+    if (!makeBounds(indexName, predicates, bounds)) {
+        return offsets;
+    }
+    if (isHash(indexName)) {
+        // a hash index only serves equalities on every attribute
+        if (!bounds.exact) {
+            throw SysError("hash index \'" + indexName +
+                           "\' cannot serve a range");
+        }
+        openTable(indexName)->findAll(bounds.lo, offsets);
+        return offsets;
+    }
+    if (isBitmap(indexName)) {
+        return intersect({indexName}, predicates);
+    }
+    bool point = bounds.exact && hasPlainKeys(indexName);
+    if (isArt(indexName)) {
+        // an art index is read in memory: a scan needs no batches
+        auto tree = openArt(indexName);
+        if (point) {
+            ART::Off offset;
+            if (tree->find(bounds.lo, offset)) {
+                offsets.push_back(offset);
+            }
+            return offsets;
+        }
+        tree->scan(bounds.hasLo ? &bounds.lo : nullptr, bounds.loInclusive,
+                   bounds.hasHi ? &bounds.hi : nullptr, bounds.hiInclusive,
+                   [&](ART::Off offset) {
+                       offsets.push_back(offset);
+                       return true;
+                   });
+        return offsets;
+    }
+    if (bounds.exact && !openBloom(indexName)->mayContain(bounds.lo)) {
+        return offsets;
+    }
+    if (point && isBuffered(indexName)) {
+        auto delta = openDelta(indexName);
+        std::lock_guard<std::mutex> lock(delta->mutex);
+        auto iter = delta->entries.find(bounds.lo);
+        if (iter != delta->entries.end()) {
+            offsets.push_back(iter->second);
+            return offsets;
+        }
+    } else {
+        merge(indexName);
+    }
+    auto tree = openTree(indexName);
+    // equal keys of a non-unique index, or keys followed by included
+    // attributes, are scanned like a range
+    if (point) {
+        auto result = tree->find(bounds.lo);
+        if (std::get<2>(result)) {
+            offsets.push_back(std::get<1>(result));
+        }
+        return offsets;
+    }
+    // drain the leaf chain a batch at a time
+    auto cursor = tree->seek(bounds.hasLo ? &bounds.lo : nullptr,
+                             bounds.loInclusive,
+                             bounds.hasHi ? &bounds.hi : nullptr,
+                             bounds.hiInclusive);
+    while (cursor.next(offsets, SCAN_BATCH)) {
+    }
+    return offsets;
+}
+
+void scanEntries(const std::string &indexName,
+                 const std::vector<Predicate> &predicates,
+                 const std::function<void(uint32_t, const Record &)> &visit) {
+    auto &index = CM::mapIndices.at(indexName);
+    auto schema = CM::getSchema(index.tableName);
+    Record row;
+    for (auto &attrName : index.columns()) {
+        for (auto &attribute : schema->attributes) {
+            if (attribute.name == attrName) {
+                row.emplace_back(attribute);
+            }
+        }
+    }
+    auto cursor = seek(indexName, predicates);
+    std::vector<uint32_t> offsets;
+    std::vector<BPlusTree::Key> keys;
+    bool more = true;
+    while (more) {
+        offsets.clear();
+        keys.clear();
+        more = cursor.next(offsets, SCAN_BATCH, &keys);
+        for (size_t i = 0; i < keys.size(); i++) {
+            const char *data = keys[i].data();
+            for (size_t j = 0; j < row.size(); j++) {
+                // the offset of a non-unique key sits before the included
+                // attributes
+                if (j == index.attrNames.size() && !index.isUnique) {
+                    data += sizeof(uint32_t);
+                }
+                data += decodeValue(data, row[j]);
+            }
+            visit(offsets[i], row);
+        }
+    }
+}
+
+std::vector<uint32_t> intersect(const std::vector<std::string> &indexNames,
+                                const std::vector<Predicate> &predicates) {
+    std::vector<std::shared_ptr<Bitmap::Index>> indexes;
+    std::vector<const Bitmap::Set *> sets;
+    std::vector<uint32_t> offsets;
+    for (auto &indexName : indexNames) {
+        Bounds bounds;
+        if (!makeBounds(indexName, predicates, bounds)) {
+            return offsets;
+        } else if (!bounds.exact) {
+            throw SysError("bitmap index \'" + indexName +
+                           "\' cannot serve a range");
+        }
+        indexes.push_back(openBitmap(indexName));
+        auto set = indexes.back()->find(bounds.lo);
+        if (set == nullptr) {
+            return offsets;
+        }
+        sets.push_back(set);
+    }
+    if (sets.empty()) {
+        return offsets;
+    }
+    // the smallest set bounds the result, so it is copied and narrowed
+    std::sort(sets.begin(), sets.end(),
+              [](const Bitmap::Set *lhs, const Bitmap::Set *rhs) -> bool {
+                  return lhs->cardinality() < rhs->cardinality();
+              });
+    Bitmap::Set result = *sets[0];
+    for (size_t i = 1; i < sets.size() && !result.empty(); i++) {
+        result.intersect(*sets[i]);
+    }
+    result.offsets(offsets);
+    return offsets;
+}
+
+size_t footprint(const std::string &indexName) {
+    return isArt(indexName) ? openArt(indexName)->footprint() : 0;
+}
+
 void exit() {
-    //
+    std::vector<std::string> indexNames;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &entry : deltas) {
+            indexNames.push_back(entry.first);
+        }
+    }
+    for (auto &indexName : indexNames) {
+        merge(indexName);
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    arts.clear();
+    for (auto &entry : blooms) {
+        entry.second->save();
+    }
+    blooms.clear();
+    for (auto &entry : bitmaps) {
+        if (entry.second->dirty) {
+            entry.second->save();
+        }
+    }
+    bitmaps.clear();
 }
 
 } // namespace IM
@@ -0,0 +1,79 @@
+#include <IndexManager/Key.h>
+#include <cmath>
+#include <cstring>
+
+namespace IM {
+
+size_t encodedWidth(ValueType type, size_t charCnt) {
+    return type == ValueType::CHAR ? charCnt + 1 : sizeof(uint32_t);
+}
+
+static void encode(std::string &key, const Value &value, bool exact) {
+    uint32_t bits;
+    switch (value.type) {
+    case ValueType::INT:
+        bits = static_cast<uint32_t>(value.ival) ^ 0x80000000u;
+        break;
+    case ValueType::FLOAT:
+        // -0.0 equals 0.0 and has to encode the same, and every NaN as
+        // the one quiet NaN, which sorts after infinity; negative floats
+        // order backwards by their bits
+        std::memcpy(&bits, &value.fval, sizeof(uint32_t));
+        if (value.fval == 0.0f && !exact) {
+            bits = 0;
+        } else if (std::isnan(value.fval)) {
+            bits = 0x7FC00000u;
+        }
+        bits = (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+        break;
+    case ValueType::CHAR:
+        key.append(value.cval, std::strlen(value.cval) + 1);
+        return;
+    }
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        key.push_back(static_cast<char>((bits >> shift) & 0xFF));
+    }
+}
+
+void encodeValue(std::string &key, const Value &value) {
+    encode(key, value, false);
+}
+
+void encodeExactValue(std::string &key, const Value &value) {
+    encode(key, value, true);
+}
+
+size_t decodeValue(const char *data, Value &value) {
+    if (value.type == ValueType::CHAR) {
+        size_t len = std::strlen(data) + 1;
+        std::memcpy(value.cval, data, len);
+        return len;
+    }
+    uint32_t bits = 0;
+    for (int i = 0; i < 4; i++) {
+        bits = bits << 8 | static_cast<unsigned char>(data[i]);
+    }
+    if (value.type == ValueType::INT) {
+        value.ival = static_cast<int>(bits ^ 0x80000000u);
+    } else {
+        bits = (bits & 0x80000000u) ? bits & 0x7FFFFFFFu : ~bits;
+        std::memcpy(&value.fval, &bits, sizeof(uint32_t));
+    }
+    return sizeof(uint32_t);
+}
+
+void encodeOffset(std::string &key, uint32_t offset) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        key.push_back(static_cast<char>((offset >> shift) & 0xFF));
+    }
+}
+
+std::string encodeKey(const std::vector<Value> &values) {
+    std::string key;
+    for (auto &value : values) {
+        encodeValue(key, value);
+    }
+    return key;
+}
+
+} // namespace IM
@@ -5,6 +5,7 @@
 #include <algorithm>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <stdexcept>
 
 namespace Interpreter {
@@ -30,6 +31,10 @@ void CreateTableStatement::addPrimaryKey(const std::string &id) {
     }
 }
 
+void CreateTableStatement::setEngine(const TableEngine value) {
+    engine = value;
+}
+
 void DropTableStatement::setTableName(const std::string &name) {
     tableName = name;
 }
@@ -42,8 +47,20 @@ void CreateIndexStatement::setTableName(const std::string &name) {
     tableName = name;
 }
 
-void CreateIndexStatement::setAttrName(const std::string &name) {
-    attrName = name;
+void CreateIndexStatement::addAttrName(const std::string &name) {
+    attrNames.push_back(name);
+}
+
+void CreateIndexStatement::addIncludeName(const std::string &name) {
+    includeNames.push_back(name);
+}
+
+void CreateIndexStatement::setIndexType(const IndexType indexType) {
+    type = indexType;
+}
+
+void CreateIndexStatement::setFillFactor(const int percent) {
+    fillFactor = percent;
 }
 
 void DropIndexStatement::setTableName(const std::string &name) {
@@ -62,6 +79,10 @@ void SelectStatement::addPredicate(const Predicate &predicate) {
     predicates.push_back(predicate);
 }
 
+void SelectStatement::setLimit(const int num) { limit = num; }
+
+void SelectStatement::setOffset(const int num) { offset = num; }
+
 void InsertStatement::setTableName(const std::string &name) {
     tableName = name;
 }
@@ -86,8 +107,11 @@ void CreateTableStatement::callAPI() const {
     if (primaryKey.empty()) {
         throw SQLError("primary key not specified");
     }
-    API::createTable(tableName, primaryKey, attributes);
+    API::createTable(tableName, primaryKey, attributes, engine);
     std::cout << "Table \'" << tableName << "\' has been created." << std::endl;
+    if (engine != TableEngine::HEAP) {
+        return;
+    }
     std::cout << "Index \'" << File::defaultIndexName(tableName, primaryKey)
               << "\' has been automatically created on \'" << primaryKey
               << "\'." << std::endl;
@@ -99,8 +123,13 @@ void DropTableStatement::callAPI() const {
 }
 
 void CreateIndexStatement::callAPI() const {
-    API::createIndex(indexName, tableName, attrName);
+    API::createIndex(indexName, tableName, attrNames, type, includeNames,
+                     fillFactor);
     std::cout << "Index \'" << indexName << "\' has been created." << std::endl;
+    if (type == IndexType::ART) {
+        std::cout << "It takes " << API::indexFootprint(indexName)
+                  << " bytes of memory." << std::endl;
+    }
 }
 
 void DropIndexStatement::callAPI() const {
@@ -109,7 +138,8 @@ void DropIndexStatement::callAPI() const {
 }
 
 void SelectStatement::callAPI() const {
-    auto results = API::select(attributes, tableName, predicates);
+    auto results =
+        API::select(attributes, tableName, predicates, limit, offset);
     auto &schema = results.first;
     auto &records = results.second;
     if (records.empty()) {
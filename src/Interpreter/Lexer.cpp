@@ -121,12 +121,18 @@ Token Lexer::nextToken() {
             return Token(Keyword::DELETE, onl, onc);
         } else if (str == "drop") {
             return Token(Keyword::DROP, onl, onc);
+        } else if (str == "engine") {
+            return Token(Keyword::ENGINE, onl, onc);
         } else if (str == "execfile") {
             return Token(Keyword::EXECFILE, onl, onc);
+        } else if (str == "fillfactor") {
+            return Token(Keyword::FILLFACTOR, onl, onc);
         } else if (str == "float") {
             return Token(Keyword::FLOAT, onl, onc);
         } else if (str == "from") {
             return Token(Keyword::FROM, onl, onc);
+        } else if (str == "include") {
+            return Token(Keyword::INCLUDE, onl, onc);
         } else if (str == "index") {
             return Token(Keyword::INDEX, onl, onc);
         } else if (str == "insert") {
@@ -137,6 +143,10 @@ Token Lexer::nextToken() {
             return Token(Keyword::INTO, onl, onc);
         } else if (str == "key") {
             return Token(Keyword::KEY, onl, onc);
+        } else if (str == "limit") {
+            return Token(Keyword::LIMIT, onl, onc);
+        } else if (str == "offset") {
+            return Token(Keyword::OFFSET, onl, onc);
         } else if (str == "on") {
             return Token(Keyword::ON, onl, onc);
         } else if (str == "primary") {
@@ -149,10 +159,14 @@ Token Lexer::nextToken() {
             return Token(Keyword::TABLE, onl, onc);
         } else if (str == "unique") {
             return Token(Keyword::UNIQUE, onl, onc);
+        } else if (str == "using") {
+            return Token(Keyword::USING, onl, onc);
         } else if (str == "values") {
             return Token(Keyword::VALUES, onl, onc);
         } else if (str == "where") {
             return Token(Keyword::WHERE, onl, onc);
+        } else if (str == "with") {
+            return Token(Keyword::WITH, onl, onc);
         } else {
             return Token(str, TokenType::identifier, onl, onc);
         }
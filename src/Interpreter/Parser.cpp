@@ -79,6 +79,18 @@ PtrStmt Parser::parseCreateTable() {
         getTableDefns(pStmt);
     }
     expect(Symbol::RPAREN);
+    if (check(Keyword::ENGINE)) {
+        skip(); // skip 'engine'
+        expect(Symbol::EQ);
+        auto engine = getIdentifier();
+        if (engine == "lsm") {
+            pStmt->setEngine(TableEngine::LSM);
+        } else if (engine == "memory") {
+            pStmt->setEngine(TableEngine::MEMORY);
+        } else if (engine != "heap") {
+            raise("unknown table engine \'" + engine + "\'");
+        }
+    }
     expect(Symbol::SEMI);
     return pStmt;
 }
@@ -98,8 +110,49 @@ PtrStmt Parser::parseCreateIndex() {
     expect(Keyword::ON);
     pStmt->setTableName(getIdentifier());
     expect(Symbol::LPAREN);
-    pStmt->setAttrName(getIdentifier());
+    pStmt->addAttrName(getIdentifier());
+    while (check(Symbol::COMMA)) {
+        skip(); // skip ','
+        pStmt->addAttrName(getIdentifier());
+    }
     expect(Symbol::RPAREN);
+    if (check(Keyword::INCLUDE)) {
+        skip(); // skip 'include'
+        expect(Symbol::LPAREN);
+        pStmt->addIncludeName(getIdentifier());
+        while (check(Symbol::COMMA)) {
+            skip(); // skip ','
+            pStmt->addIncludeName(getIdentifier());
+        }
+        expect(Symbol::RPAREN);
+    }
+    if (check(Keyword::USING)) {
+        skip(); // skip 'using'
+        auto type = getIdentifier();
+        if (type == "hash") {
+            pStmt->setIndexType(IndexType::HASH);
+        } else if (type == "buffered") {
+            pStmt->setIndexType(IndexType::BUFFERED);
+        } else if (type == "art") {
+            pStmt->setIndexType(IndexType::ART);
+        } else if (type == "bitmap") {
+            pStmt->setIndexType(IndexType::BITMAP);
+        } else if (type != "btree") {
+            raise("unknown index type \'" + type + "\'");
+        }
+    }
+    if (check(Keyword::WITH)) {
+        skip(); // skip 'with'
+        expect(Keyword::FILLFACTOR);
+        expect(Symbol::EQ);
+        int fillFactor = getInteger();
+        if (fillFactor < 10 || fillFactor > 100) {
+            --p;
+            throw ParseError("fill factor should be between 10 and 100",
+                             p->getNl(), p->getNc());
+        }
+        pStmt->setFillFactor(fillFactor);
+    }
     expect(Symbol::SEMI);
     return pStmt;
 }
@@ -134,6 +187,14 @@ PtrStmt Parser::parseSelect() {
             pStmt->addPredicate(getPredicate());
         }
     }
+    if (check(Keyword::LIMIT)) {
+        skip(); // skip 'limit'
+        pStmt->setLimit(getCount());
+        if (check(Keyword::OFFSET)) {
+            skip(); // skip 'offset'
+            pStmt->setOffset(getCount());
+        }
+    }
     expect(Symbol::SEMI);
     return pStmt;
 }
@@ -333,6 +394,16 @@ int Parser::getInteger() {
     }
 }
 
+int Parser::getCount() {
+    int num = getInteger();
+    if (num < 0) {
+        --p;
+        throw ParseError("row count should not be negative", p->getNl(),
+                         p->getNc());
+    }
+    return num;
+}
+
 float Parser::getFloating() {
     if (p != tokens.end() && p->getType() == TokenType::floating) {
         return (p++)->getValue().floatval;
@@ -44,9 +44,10 @@ int Token::getNl() const { return nl; }
 int Token::getNc() const { return nc; }
 
 static const char *keywords[] = {
-    "and",     "char",  "create", "delete", "drop",   "execfile", "float",
-    "from",    "index", "insert", "int",    "into",   "key",      "on",
-    "primary", "quit",  "select", "table",  "unique", "values",   "where"};
+    "and",        "char",  "create", "delete",  "drop",   "engine",  "execfile",
+    "fillfactor", "float", "from",   "include", "index",  "insert",  "int",
+    "into",       "key",   "limit",  "offset",  "on",     "primary", "quit",
+    "select",     "table", "unique", "using",   "values", "where",   "with"};
 
 static const char *symbols[] = {"(",  ")",  ";", ",",  "=", "<",
                                 "<=", "<>", ">", ">=", "*"};
@@ -0,0 +1,697 @@
+#include <BufferManager/BufferManager.h>
+#include <Error.h>
+#include <FileSpec.h>
+#include <IndexManager/Key.h>
+#include <RecordManager/LSM.h>
+#include <RecordManager/RecordSpec.h>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace RM {
+
+namespace LSM {
+
+// Most runs a table lists in its block 0. A table that reaches it waits
+// for the merge under way before writing out another run.
+constexpr size_t MAX_RUNS = 256;
+
+static uint32_t wordOf(const char *entry) {
+    uint32_t word;
+    std::memcpy(&word, entry, sizeof(uint32_t));
+    return word;
+}
+
+// Entries are record images, or deletions that only carry the id with
+// the deleted mark set.
+static uint32_t idOf(const char *entry) { return wordOf(entry) & DELETED_MASK; }
+
+static bool isDeletion(const char *entry) {
+    return (wordOf(entry) & DELETED_MARK) != 0;
+}
+
+// Calls `visit` with each bit of a filter of `bits` bits that stands for
+// the key, until it returns false. The hash is FNV-1a, which is the same
+// in every build, as filters are written to disk.
+template <typename Visitor>
+static bool probe(const char *key, size_t len, uint32_t bits, Visitor visit) {
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ static_cast<unsigned char>(key[i])) * 0x100000001B3ULL;
+    }
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    h ^= h >> 31;
+    uint32_t h1 = static_cast<uint32_t>(h), h2 = (h >> 32) | 1;
+    for (uint32_t i = 0; i < BLOOM_PROBES; i++) {
+        if (!visit((h1 + i * h2) % bits)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// An immutable run. Its entries, each the key followed by the image, fill
+// the blocks from 1 on, as many to a block as fit, in key order.
+struct Run {
+    std::string filename;
+    uint32_t num;
+    File::runFileHeader header;
+    uint32_t entryWidth;
+    uint32_t perBlock;
+    std::string fences; // first key of each data block
+    std::vector<uint64_t> bloom;
+
+    bool mayContain(const std::string &key) const {
+        return probe(key.data(), key.size(), header.bloomBits,
+                     [&](uint32_t bit) {
+                         return ((bloom[bit / 64] >> (bit % 64)) & 1) != 0;
+                     });
+    }
+
+    // Points `entry` at the entry of the key, within `blk`.
+    bool find(const std::string &key, BM::PtrBlock &blk,
+              const char *&entry) const {
+        size_t width = header.keyWidth;
+        if (header.numEntries == 0 ||
+            std::memcmp(key.data(), fences.data(), width) < 0 ||
+            !mayContain(key)) {
+            return false;
+        }
+        // the last block whose first key is not greater than the key
+        uint32_t lo = 1, hi = fences.size() / width;
+        while (lo < hi) {
+            uint32_t mid = (lo + hi) / 2;
+            if (std::memcmp(fences.data() + mid * width, key.data(), width) <=
+                0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        uint32_t b = lo - 1;
+        blk = BM::readBlock(BM::makeID(filename, b + 1));
+        uint32_t num = std::min(perBlock, header.numEntries - b * perBlock);
+        lo = 0;
+        hi = num;
+        while (lo < hi) {
+            uint32_t mid = (lo + hi) / 2;
+            if (std::memcmp(blk->block_data + mid * entryWidth, key.data(),
+                            width) < 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        entry = blk->block_data + lo * entryWidth;
+        return lo < num && std::memcmp(entry, key.data(), width) == 0;
+    }
+};
+
+using PtrRun = std::shared_ptr<Run>;
+
+// Walks the entries of a run in key order.
+struct Cursor {
+    const Run *run;
+    uint32_t index;
+    BM::PtrBlock blk;
+    const char *entry;
+
+    Cursor(const Run *run) : run(run), index(0), entry(nullptr) { load(); }
+    bool valid() const { return index < run->header.numEntries; }
+    const char *key() const { return entry; }
+    const char *image() const { return entry + run->header.keyWidth; }
+    void load() {
+        if (!valid()) {
+            return;
+        }
+        uint32_t slot = index % run->perBlock;
+        if (slot == 0 || !blk) {
+            blk = BM::readBlock(
+                BM::makeID(run->filename, 1 + index / run->perBlock));
+        }
+        entry = blk->block_data + slot * run->entryWidth;
+    }
+    void advance() {
+        index++;
+        load();
+    }
+};
+
+// Writes the entries of a run, given in key order, straight to its file;
+// its blocks are only read through the buffer manager once it is done.
+class RunWriter {
+  public:
+    RunWriter(const std::string &tableName, uint32_t num, uint32_t keyWidth,
+              uint32_t entrySize, size_t capacity)
+        : run(std::make_shared<Run>()), done(false) {
+        run->filename = File::sortedRunFilename(tableName, num);
+        run->num = num;
+        ofs.open(run->filename, std::ios::out | std::ios::binary);
+        if (ofs.fail()) {
+            throw SysError("cannot create file \'" + run->filename + "\'");
+        }
+        auto &header = run->header;
+        header.filetype = static_cast<uint32_t>(File::FileType::RUN);
+        header.numBlocks = 1;
+        header.numEntries = 0;
+        header.entrySize = entrySize;
+        header.keyWidth = keyWidth;
+        header.bloomBits =
+            (std::max<size_t>(capacity, 1) * BLOOM_BITS + 63) / 64 * 64;
+        run->entryWidth = keyWidth + entrySize;
+        run->perBlock = BM::BLOCK_SIZE / run->entryWidth;
+        run->bloom.assign(header.bloomBits / 64, 0);
+        std::memset(block, 0, BM::BLOCK_SIZE);
+        ofs.write(block, BM::BLOCK_SIZE); // the header goes here when done
+    }
+
+    ~RunWriter() {
+        if (!done) {
+            ofs.close();
+            std::remove(run->filename.c_str());
+        }
+    }
+
+    size_t size() const { return run->header.numEntries; }
+
+    void add(const char *key, const char *image) {
+        auto &header = run->header;
+        uint32_t slot = header.numEntries % run->perBlock;
+        if (slot == 0) {
+            if (header.numEntries > 0) {
+                flushBlock();
+            }
+            run->fences.append(key, header.keyWidth);
+        }
+        char *dest = block + slot * run->entryWidth;
+        std::memcpy(dest, key, header.keyWidth);
+        std::memcpy(dest + header.keyWidth, image, header.entrySize);
+        header.numEntries++;
+        probe(key, header.keyWidth, header.bloomBits, [&](uint32_t bit) {
+            run->bloom[bit / 64] |= 1ULL << (bit % 64);
+            return true;
+        });
+    }
+
+    PtrRun finish() {
+        auto &header = run->header;
+        if (header.numEntries > 0) {
+            flushBlock();
+        }
+        header.fenceOffset = header.numBlocks;
+        writeArray(run->fences.data(), run->fences.size());
+        header.bloomOffset = header.numBlocks;
+        writeArray(run->bloom.data(), run->bloom.size() * sizeof(uint64_t));
+        ofs.seekp(0, std::ios::beg);
+        ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        ofs.close();
+        if (ofs.fail()) {
+            throw SysError("cannot write file \'" + run->filename + "\'");
+        }
+        done = true;
+        return run;
+    }
+
+  private:
+    PtrRun run;
+    std::ofstream ofs;
+    char block[BM::BLOCK_SIZE];
+    bool done;
+
+    void flushBlock() {
+        ofs.write(block, BM::BLOCK_SIZE);
+        std::memset(block, 0, BM::BLOCK_SIZE);
+        run->header.numBlocks++;
+    }
+
+    void writeArray(const void *src, size_t size) {
+        auto pos = static_cast<const char *>(src);
+        for (size_t off = 0; off < size; off += BM::BLOCK_SIZE) {
+            std::memcpy(block, pos + off, std::min(BM::BLOCK_SIZE, size - off));
+            flushBlock();
+        }
+    }
+};
+
+using Memtable = std::map<std::string, std::string>;
+
+// Calls `visit` with the key and the newest entry of each key in the runs,
+// given oldest first, and in the memtable if there is one, in key order
+// until it returns false.
+template <typename Visitor>
+static void merge(const std::vector<PtrRun> &runs, size_t keyWidth,
+                  const Memtable *memtable, Visitor visit) {
+    std::vector<Cursor> cursors;
+    for (auto &run : runs) {
+        cursors.emplace_back(run.get());
+    }
+    Memtable::const_iterator iter, end;
+    if (memtable != nullptr) {
+        iter = memtable->begin();
+        end = memtable->end();
+    }
+    std::string key;
+    for (;;) {
+        const char *least = nullptr, *newest = nullptr;
+        for (auto &cursor : cursors) {
+            if (cursor.valid() &&
+                (least == nullptr ||
+                 std::memcmp(cursor.key(), least, keyWidth) <= 0)) {
+                least = cursor.key();
+                newest = cursor.image();
+            }
+        }
+        if (memtable != nullptr && iter != end &&
+            (least == nullptr ||
+             std::memcmp(iter->first.data(), least, keyWidth) <= 0)) {
+            least = iter->first.data();
+            newest = iter->second.data();
+        }
+        if (newest == nullptr) {
+            return;
+        }
+        // the cursors move on before the next call, and with them `least`
+        key.assign(least, keyWidth);
+        if (!visit(key, newest)) {
+            return;
+        }
+        for (auto &cursor : cursors) {
+            if (cursor.valid() &&
+                std::memcmp(cursor.key(), key.data(), keyWidth) == 0) {
+                cursor.advance();
+            }
+        }
+        if (memtable != nullptr && iter != end && iter->first == key) {
+            ++iter;
+        }
+    }
+}
+
+struct Table {
+    std::string tableName;
+    std::string filename;
+    File::lsmFileHeader header;
+    Attribute key;      // the primary key
+    uint32_t keyOffset; // of the primary key in an image
+    size_t keyWidth;    // of the encoded primary key
+    // new records and deletions of records already in runs
+    Memtable memtable;
+    std::vector<PtrRun> runs; // oldest first
+    std::unordered_map<uint32_t, std::string> keys; // of the live records
+    // guards the above, which the merge swaps its output in for its inputs
+    std::mutex mutex;
+    std::thread merger;
+    std::atomic<bool> merging;
+    // what the last merge failed with, until an operation reports it
+    std::exception_ptr error;
+    Table() : merging(false) {}
+
+    std::string keyOf(const char *image) const {
+        Value value(key);
+        if (value.type == ValueType::CHAR) {
+            value.cval[value.charCnt] = '\0';
+        }
+        std::memcpy(value.val(), image + keyOffset, value.size());
+        std::string encoded;
+        IM::encodeValue(encoded, value);
+        // a char key is as long as its string; the NULs padding it to the
+        // width sort it before any longer one all the same
+        encoded.resize(keyWidth, '\0');
+        return encoded;
+    }
+};
+
+static void readArray(const std::string &filename, uint32_t blkOff, void *dest,
+                      size_t size) {
+    auto pos = static_cast<char *>(dest);
+    for (size_t off = 0; off < size; off += BM::BLOCK_SIZE, blkOff++) {
+        BM::PtrBlock blk = BM::readBlock(BM::makeID(filename, blkOff));
+        std::memcpy(pos + off, blk->block_data,
+                    std::min(BM::BLOCK_SIZE, size - off));
+    }
+}
+
+static PtrRun openRun(const Table &table, uint32_t num) {
+    auto &tableName = table.tableName;
+    auto run = std::make_shared<Run>();
+    run->filename = File::sortedRunFilename(tableName, num);
+    run->num = num;
+    if (!BM::fileExists(run->filename)) {
+        throw SysError("missing run " + std::to_string(num) + " of table \'" +
+                       tableName + "\'");
+    }
+    BM::PtrBlock blk0 = BM::readBlock(BM::makeID(run->filename, 0));
+    std::memcpy(&run->header, blk0->block_data, sizeof(run->header));
+    auto &header = run->header;
+    if (header.filetype != static_cast<uint32_t>(File::FileType::RUN) ||
+        header.keyWidth != table.keyWidth ||
+        header.entrySize != table.header.entrySize) {
+        throw SysError("file type not compatible");
+    }
+    run->entryWidth = header.keyWidth + header.entrySize;
+    run->perBlock = BM::BLOCK_SIZE / run->entryWidth;
+    uint32_t numBlocks = header.fenceOffset - 1;
+    run->fences.resize(numBlocks * header.keyWidth);
+    readArray(run->filename, header.fenceOffset, &run->fences[0],
+              run->fences.size());
+    run->bloom.resize(header.bloomBits / 64);
+    readArray(run->filename, header.bloomOffset, run->bloom.data(),
+              run->bloom.size() * sizeof(uint64_t));
+    return run;
+}
+
+static std::unordered_map<std::string, std::unique_ptr<Table>> tables;
+
+static void writeManifest(Table &table) {
+    auto &header = table.header;
+    header.numRuns = table.runs.size();
+    std::vector<uint32_t> nums;
+    for (auto &run : table.runs) {
+        nums.push_back(run->num);
+    }
+    auto id = BM::makeID(table.filename, 0);
+    BM::writeBlock(id, reinterpret_cast<const char *>(&header), 0,
+                   sizeof(header));
+    if (!nums.empty()) {
+        BM::writeBlock(id, reinterpret_cast<const char *>(nums.data()),
+                       sizeof(header), nums.size() * sizeof(uint32_t));
+    }
+}
+
+static Table &makeTable(const Schema &schema) {
+    std::unique_ptr<Table> table(new Table);
+    table->tableName = schema.tableName;
+    table->filename = File::tableFilename(schema.tableName);
+    table->keyOffset = sizeof(uint32_t); // the id goes first
+    for (auto &attribute : schema.attributes) {
+        if (attribute.name == schema.primaryKey) {
+            table->key = attribute;
+            break;
+        }
+        table->keyOffset += attribute.size();
+    }
+    table->keyWidth = IM::encodedWidth(table->key.type, table->key.charCnt);
+    auto &ref = *table;
+    tables[schema.tableName] = std::move(table);
+    return ref;
+}
+
+static Table &getTable(const std::string &tableName) {
+    auto iter = tables.find(tableName);
+    if (iter == tables.end()) {
+        throw SysError("missing data for table \'" + tableName + "\'");
+    }
+    return *iter->second;
+}
+
+// Reports, once, the error the last merge of the table failed with. Merges
+// are not started again until it has been.
+static void check(Table &table) {
+    if (table.error) {
+        auto error = table.error;
+        table.error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+static void wait(Table &table) {
+    if (table.merger.joinable()) {
+        table.merger.join();
+    }
+}
+
+// Merges the runs into one, which takes their place once written. Every
+// older entry of a key is among them, so deleted records are dropped along
+// with their deletions.
+static void mergeRuns(Table *table, std::vector<PtrRun> inputs, uint32_t num) {
+    try {
+        size_t capacity = 0;
+        for (auto &run : inputs) {
+            capacity += run->header.numEntries;
+        }
+        RunWriter writer(table->tableName, num, table->keyWidth,
+                         table->header.entrySize, capacity);
+        merge(inputs, table->keyWidth, nullptr,
+              [&](const std::string &key, const char *image) {
+                  if (!isDeletion(image)) {
+                      writer.add(key.data(), image);
+                  }
+                  return true;
+              });
+        PtrRun output = writer.size() > 0 ? writer.finish() : nullptr;
+        {
+            std::lock_guard<std::mutex> lock(table->mutex);
+            auto &runs = table->runs;
+            runs.erase(runs.begin(), runs.begin() + inputs.size());
+            if (output) {
+                runs.insert(runs.begin(), output);
+            }
+            writeManifest(*table);
+        }
+        for (auto &run : inputs) {
+            BM::deleteFile(run->filename);
+        }
+    } catch (std::exception &e) {
+        // the inputs stay, to be merged again once the error is reported
+        std::lock_guard<std::mutex> lock(table->mutex);
+        table->error = std::make_exception_ptr(
+            SysError("cannot merge the runs of table \'" + table->tableName +
+                     "\': " + e.what()));
+    }
+    table->merging = false;
+}
+
+// Writes the memtable out as a run; enough runs are then merged in the
+// background.
+static void flush(Table &table, std::unique_lock<std::mutex> &lock,
+                  bool merge) {
+    if (table.memtable.empty()) {
+        return;
+    }
+    if (table.runs.size() >= MAX_RUNS) {
+        lock.unlock();
+        wait(table);
+        lock.lock();
+    }
+    RunWriter writer(table.tableName, table.header.nextRun++, table.keyWidth,
+                     table.header.entrySize, table.memtable.size());
+    for (auto &entry : table.memtable) {
+        writer.add(entry.first.data(), entry.second.data());
+    }
+    table.runs.push_back(writer.finish());
+    table.memtable.clear();
+    writeManifest(table);
+
+    if (merge && table.runs.size() >= MERGE_RUNS && !table.merging &&
+        !table.error) {
+        wait(table); // a merge that is done, if any
+        table.merging = true;
+        table.merger = std::thread(mergeRuns, &table, table.runs,
+                                   table.header.nextRun++);
+    }
+}
+
+void open(std::shared_ptr<Schema> schema) {
+    auto &tableName = schema->tableName;
+    auto filename = File::tableFilename(tableName);
+    if (!BM::fileExists(filename)) {
+        throw SysError("missing data for table \'" + tableName + "\'");
+    }
+    File::lsmFileHeader header;
+    BM::PtrBlock blk0 = BM::readBlock(BM::makeID(filename, 0));
+    std::memcpy(&header, blk0->block_data, sizeof(header));
+    if (header.filetype != static_cast<uint32_t>(File::FileType::LSM)) {
+        throw SysError("file type not compatible");
+    }
+    if (header.version != File::LSM_VERSION) {
+        throw SysError("file \'" + filename +
+                       "\' has an older layout; recreate the table");
+    }
+    auto &table = makeTable(*schema);
+    table.header = header;
+    try {
+        for (uint32_t i = 0; i < header.numRuns; i++) {
+            uint32_t num;
+            std::memcpy(&num,
+                        blk0->block_data + sizeof(header) +
+                            i * sizeof(uint32_t),
+                        sizeof(uint32_t));
+            table.runs.push_back(openRun(table, num));
+        }
+        merge(table.runs, table.keyWidth, nullptr,
+              [&](const std::string &key, const char *image) {
+                  if (!isDeletion(image)) {
+                      table.keys[idOf(image)] = key;
+                  }
+                  return true;
+              });
+    } catch (...) {
+        tables.erase(tableName);
+        throw;
+    }
+}
+
+void createTable(std::shared_ptr<Schema> schema) {
+    auto filename = File::tableFilename(schema->tableName);
+    BM::createFile(filename, File::FileType::LSM);
+    auto &table = makeTable(*schema);
+    BM::PtrBlock blk0 = BM::readBlock(BM::makeID(filename, 0));
+    std::memcpy(&table.header, blk0->block_data, sizeof(table.header));
+    table.header.entrySize = recordBinarySize(*schema);
+    writeManifest(table);
+}
+
+void dropTable(const std::string &tableName) {
+    auto &table = getTable(tableName);
+    wait(table);
+    for (auto &run : table.runs) {
+        BM::deleteFile(run->filename);
+    }
+    BM::deleteFile(table.filename);
+    tables.erase(tableName);
+}
+
+uint32_t insert(const std::string &tableName, std::string image) {
+    auto &table = getTable(tableName);
+    std::unique_lock<std::mutex> lock(table.mutex);
+    check(table);
+    uint32_t id = table.header.nextId;
+    if (id & DELETED_MARK) {
+        throw SQLError("table \'" + tableName + "\' is out of record ids");
+    }
+    table.header.nextId++;
+    table.header.numRecords++;
+    std::memcpy(&image[0], &id, sizeof(uint32_t));
+    auto key = table.keyOf(image.data());
+    table.keys[id] = key;
+    // in place of the deletion of an earlier record with the key, if any
+    table.memtable[key] = std::move(image);
+    if (table.memtable.size() >= MEMTABLE_SIZE) {
+        flush(table, lock, true);
+    }
+    return id;
+}
+
+// Finds the newest entry of the key, which `image` holds a copy of.
+static bool lookup(Table &table, const std::string &key, std::string &image) {
+    auto iter = table.memtable.find(key);
+    if (iter != table.memtable.end()) {
+        image = iter->second;
+        return true;
+    }
+    BM::PtrBlock blk;
+    const char *entry;
+    for (auto run = table.runs.rbegin(); run != table.runs.rend(); ++run) {
+        if ((*run)->find(key, blk, entry)) {
+            image.assign(entry + table.keyWidth, table.header.entrySize);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool get(const std::string &tableName, uint32_t id, std::string &image) {
+    auto &table = getTable(tableName);
+    std::lock_guard<std::mutex> lock(table.mutex);
+    check(table);
+    auto iter = table.keys.find(id);
+    return iter != table.keys.end() && lookup(table, iter->second, image) &&
+           !isDeletion(image.data()) && idOf(image.data()) == id;
+}
+
+bool find(const std::string &tableName, const Value &value, uint32_t &id) {
+    auto &table = getTable(tableName);
+    std::lock_guard<std::mutex> lock(table.mutex);
+    check(table);
+    std::string key, image;
+    IM::encodeValue(key, value);
+    if (key.size() > table.keyWidth) {
+        return false; // longer than any key of the table
+    }
+    key.resize(table.keyWidth, '\0');
+    if (!lookup(table, key, image) || isDeletion(image.data())) {
+        return false;
+    }
+    id = idOf(image.data());
+    return true;
+}
+
+void erase(const std::string &tableName, uint32_t id) {
+    auto &table = getTable(tableName);
+    std::unique_lock<std::mutex> lock(table.mutex);
+    check(table);
+    auto iter = table.keys.find(id);
+    if (iter == table.keys.end()) {
+        throw SysError("record has already been deleted");
+    }
+    auto key = std::move(iter->second);
+    table.keys.erase(iter);
+    table.header.numRecords--;
+    // a key that no run may hold needs no deletion to hide it
+    if (std::none_of(table.runs.begin(), table.runs.end(),
+                     [&](const PtrRun &run) { return run->mayContain(key); })) {
+        table.memtable.erase(key);
+        return;
+    }
+    std::string deletion(table.header.entrySize, '\0');
+    uint32_t word = id | DELETED_MARK;
+    std::memcpy(&deletion[0], &word, sizeof(uint32_t));
+    table.memtable[key] = std::move(deletion);
+    if (table.memtable.size() >= MEMTABLE_SIZE) {
+        flush(table, lock, true);
+    }
+}
+
+int clear(const std::string &tableName) {
+    auto &table = getTable(tableName);
+    wait(table);
+    std::lock_guard<std::mutex> lock(table.mutex);
+    check(table);
+    int numDeleted = static_cast<int>(table.header.numRecords);
+    for (auto &run : table.runs) {
+        BM::deleteFile(run->filename);
+    }
+    table.runs.clear();
+    table.memtable.clear();
+    table.keys.clear();
+    table.header.numRecords = 0;
+    writeManifest(table);
+    return numDeleted;
+}
+
+void scan(const std::string &tableName,
+          const std::function<bool(uint32_t, const char *)> &visit) {
+    auto &table = getTable(tableName);
+    std::lock_guard<std::mutex> lock(table.mutex);
+    check(table);
+    merge(table.runs, table.keyWidth, &table.memtable,
+          [&](const std::string &, const char *image) {
+              return isDeletion(image) || visit(idOf(image), image);
+          });
+}
+
+void exit() {
+    for (auto &entry : tables) {
+        auto &table = *entry.second;
+        wait(table);
+        std::unique_lock<std::mutex> lock(table.mutex);
+        flush(table, lock, false);
+        writeManifest(table);
+    }
+    tables.clear();
+}
+
+} // namespace LSM
+
+} // namespace RM
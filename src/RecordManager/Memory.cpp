@@ -0,0 +1,245 @@
+#include <Error.h>
+#include <FileSpec.h>
+#include <IndexManager/Key.h>
+#include <RecordManager/Memory.h>
+#include <RecordManager/RecordSpec.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace RM {
+
+namespace Memory {
+
+struct Table {
+    std::string tableName;
+    uint32_t entrySize;
+    Attribute key;      // the primary key
+    uint32_t keyOffset; // of the primary key in an image
+    uint32_t numSlots;  // slots handed out, deleted or not
+    uint32_t numRecords;
+    std::vector<std::unique_ptr<char[]>> pages;
+    std::unordered_map<std::string, uint32_t> primary;
+
+    char *slot(uint32_t id) const {
+        uint32_t i = id - 1;
+        return pages[i / PAGE_RECORDS].get() + (i % PAGE_RECORDS) * entrySize;
+    }
+
+    // Hands out the next slot.
+    char *append() {
+        if (numSlots % PAGE_RECORDS == 0) {
+            pages.emplace_back(new char[PAGE_RECORDS * entrySize]);
+        }
+        return slot(++numSlots);
+    }
+
+    std::string keyOf(const char *image) const {
+        Value value(key);
+        if (value.type == ValueType::CHAR) {
+            value.cval[value.charCnt] = '\0';
+        }
+        std::memcpy(value.val(), image + keyOffset, value.size());
+        std::string encoded;
+        IM::encodeValue(encoded, value);
+        return encoded;
+    }
+};
+
+static std::unordered_map<std::string, std::unique_ptr<Table>> tables;
+
+static uint32_t wordOf(const char *image) {
+    uint32_t word;
+    std::memcpy(&word, image, sizeof(uint32_t));
+    return word;
+}
+
+static Table &getTable(const std::string &tableName) {
+    auto iter = tables.find(tableName);
+    if (iter == tables.end()) {
+        throw SysError("missing data for table \'" + tableName + "\'");
+    }
+    return *iter->second;
+}
+
+static Table &makeTable(const Schema &schema) {
+    std::unique_ptr<Table> table(new Table);
+    table->tableName = schema.tableName;
+    table->entrySize = recordBinarySize(schema);
+    table->keyOffset = sizeof(uint32_t); // the slot goes first
+    for (auto &attribute : schema.attributes) {
+        if (attribute.name == schema.primaryKey) {
+            table->key = attribute;
+            break;
+        }
+        table->keyOffset += attribute.size();
+    }
+    table->numSlots = 0;
+    table->numRecords = 0;
+    auto &ref = *table;
+    tables[schema.tableName] = std::move(table);
+    return ref;
+}
+
+// Writes the live records along with the number of slots, so that they
+// come back in the slots the indexes know them by.
+static void snapshot(const Table &table) {
+    auto filename = File::memoryFilename(table.tableName);
+    auto tmpFilename = filename + ".tmp";
+    std::ofstream ofs(tmpFilename, std::ios::out | std::ios::binary);
+    if (ofs.fail()) {
+        throw SysError("cannot create file \'" + tmpFilename + "\'");
+    }
+    File::memoryFileHeader header;
+    header.filetype = static_cast<uint32_t>(File::FileType::MEMORY);
+    header.entrySize = table.entrySize;
+    header.numSlots = table.numSlots;
+    header.numRecords = table.numRecords;
+    ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (uint32_t id = 1; id <= table.numSlots; id++) {
+        const char *image = table.slot(id);
+        if (!(wordOf(image) & DELETED_MARK)) {
+            ofs.write(image, table.entrySize);
+        }
+    }
+    ofs.close();
+    if (ofs.fail() || std::rename(tmpFilename.c_str(), filename.c_str())) {
+        throw SysError("cannot write file \'" + filename + "\'");
+    }
+}
+
+bool hasTable(const std::string &tableName) {
+    return tables.find(tableName) != tables.end();
+}
+
+void open(std::shared_ptr<Schema> schema) {
+    auto filename = File::memoryFilename(schema->tableName);
+    std::ifstream ifs(filename, std::ios::in | std::ios::binary);
+    if (ifs.fail()) {
+        throw SysError("missing data for table \'" + schema->tableName + "\'");
+    }
+    File::memoryFileHeader header;
+    ifs.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!ifs ||
+        header.filetype != static_cast<uint32_t>(File::FileType::MEMORY)) {
+        throw SysError("file type not compatible");
+    }
+    auto &table = makeTable(*schema);
+    if (header.entrySize != table.entrySize) {
+        tables.erase(schema->tableName);
+        throw SysError("file type not compatible");
+    }
+    std::unique_ptr<char[]> image(new char[table.entrySize]);
+    for (uint32_t i = 0; i < header.numRecords; i++) {
+        ifs.read(image.get(), table.entrySize);
+        uint32_t id = wordOf(image.get());
+        // the slots between the records were deleted
+        while (table.numSlots < id) {
+            uint32_t mark = DELETED_MARK;
+            std::memcpy(table.append(), &mark, sizeof(uint32_t));
+        }
+        std::memcpy(table.slot(id), image.get(), table.entrySize);
+        table.primary[table.keyOf(image.get())] = id;
+    }
+    while (table.numSlots < header.numSlots) {
+        uint32_t mark = DELETED_MARK;
+        std::memcpy(table.append(), &mark, sizeof(uint32_t));
+    }
+    table.numRecords = header.numRecords;
+    if (!ifs) {
+        tables.erase(schema->tableName);
+        throw SysError("missing data for table \'" + schema->tableName + "\'");
+    }
+}
+
+void createTable(std::shared_ptr<Schema> schema) {
+    snapshot(makeTable(*schema));
+}
+
+void dropTable(const std::string &tableName) {
+    getTable(tableName);
+    tables.erase(tableName);
+    std::remove(File::memoryFilename(tableName).c_str());
+}
+
+uint32_t insert(const std::string &tableName, const char *image) {
+    auto &table = getTable(tableName);
+    if (table.numSlots == DELETED_MASK) {
+        throw SQLError("table \'" + tableName + "\' is out of slots");
+    }
+    char *dest = table.append();
+    uint32_t id = table.numSlots;
+    std::memcpy(dest, image, table.entrySize);
+    std::memcpy(dest, &id, sizeof(uint32_t));
+    table.primary[table.keyOf(dest)] = id;
+    table.numRecords++;
+    return id;
+}
+
+const char *get(const std::string &tableName, uint32_t id) {
+    auto &table = getTable(tableName);
+    if (id == 0 || id > table.numSlots) {
+        return nullptr;
+    }
+    const char *image = table.slot(id);
+    return (wordOf(image) & DELETED_MARK) ? nullptr : image;
+}
+
+bool find(const std::string &tableName, const Value &value, uint32_t &id) {
+    auto &table = getTable(tableName);
+    std::string key;
+    IM::encodeValue(key, value);
+    auto iter = table.primary.find(key);
+    if (iter == table.primary.end()) {
+        return false;
+    }
+    id = iter->second;
+    return true;
+}
+
+void erase(const std::string &tableName, uint32_t id) {
+    auto &table = getTable(tableName);
+    if (get(tableName, id) == nullptr) {
+        throw SysError("record has already been deleted");
+    }
+    char *image = table.slot(id);
+    table.primary.erase(table.keyOf(image));
+    uint32_t mark = id | DELETED_MARK;
+    std::memcpy(image, &mark, sizeof(uint32_t));
+    table.numRecords--;
+}
+
+int clear(const std::string &tableName) {
+    auto &table = getTable(tableName);
+    int numDeleted = static_cast<int>(table.numRecords);
+    table.pages.clear();
+    table.primary.clear();
+    table.numSlots = 0;
+    table.numRecords = 0;
+    return numDeleted;
+}
+
+void scan(const std::string &tableName,
+          const std::function<bool(uint32_t, const char *)> &visit) {
+    auto &table = getTable(tableName);
+    for (uint32_t id = 1; id <= table.numSlots; id++) {
+        const char *image = table.slot(id);
+        if (!(wordOf(image) & DELETED_MARK) && !visit(id, image)) {
+            return;
+        }
+    }
+}
+
+void exit() {
+    for (auto &entry : tables) {
+        snapshot(*entry.second);
+    }
+    tables.clear();
+}
+
+} // namespace Memory
+
+} // namespace RM
@@ -1,65 +1,312 @@
 #include <CatalogManager/CatalogManager.h>
 #include <Error.h>
 #include <FileSpec.h>
+#include <RecordManager/LSM.h>
+#include <RecordManager/Memory.h>
 #include <RecordManager/RecordManager.h>
 #include <RecordManager/RecordSpec.h>
+#include <RecordManager/Zone.h>
 #include <algorithm>
+#include <cstring>
 
 namespace RM {
 
 void init() {
     auto &schemas = CM::mapSchemas;
     for (auto &schema : schemas) {
+        if (schema.second->engine == TableEngine::MEMORY) {
+            Memory::open(schema.second);
+        }
         if (!hasTable(schema.first)) {
             throw SysError("missing data for table \'" + schema.first + "\'");
         }
+        if (schema.second->engine == TableEngine::LSM) {
+            LSM::open(schema.second);
+        }
     }
 }
 
-static bool satisfy(std::shared_ptr<Schema> schema, const Predicate &predicate,
-                    const Record &record) {
-    for (int i = 0; i < record.size(); i++) {
-        auto &attribute = schema->attributes[i];
-        if (predicate.attrName == attribute.name) {
-            auto &value = record[i];
-            switch (predicate.op) {
-            case OpType::EQ:
-                return value == predicate.val;
-            case OpType::NE:
-                return value != predicate.val;
-            case OpType::LT:
-                return value < predicate.val;
-            case OpType::LEQ:
-                return value <= predicate.val;
-            case OpType::GT:
-                return value > predicate.val;
-            case OpType::GEQ:
-                return value >= predicate.val;
+// Columns a scan has to decode, and where to find them in a record.
+// Predicates and the projection refer to slots of the decoded row rather
+// than to positions in the schema, so untouched columns are never copied.
+struct ScanPlan {
+    std::vector<const Attribute *> columns;
+    std::vector<uint32_t> offsets;
+    std::vector<std::pair<int, const Predicate *>> predicates;
+    std::vector<int> projection;
+};
+
+static int findAttribute(const Schema &schema, const std::string &attrName) {
+    for (size_t i = 0; i < schema.attributes.size(); i++) {
+        if (schema.attributes[i].name == attrName) {
+            return i;
+        }
+    }
+    throw SQLError("cannot find attribute \'" + attrName + "\' in table \'" +
+                   schema.tableName + "\'");
+}
+
+static ScanPlan makePlan(const Schema &schema,
+                         const std::vector<Predicate> &predicates,
+                         const std::vector<std::string> &attributes) {
+    int numAttrs = schema.attributes.size();
+    std::vector<int> slots(numAttrs, -1);
+    std::vector<int> projection;
+    std::vector<std::pair<int, const Predicate *>> bound;
+    if (attributes.empty()) {
+        for (int i = 0; i < numAttrs; i++) {
+            slots[i] = i;
+            projection.push_back(i);
+        }
+    } else {
+        for (auto &attrName : attributes) {
+            int i = findAttribute(schema, attrName);
+            slots[i] = i;
+            projection.push_back(i);
+        }
+    }
+    for (auto &predicate : predicates) {
+        int i = findAttribute(schema, predicate.attrName);
+        slots[i] = i;
+        bound.emplace_back(i, &predicate);
+    }
+
+    // decoded rows keep the on-disk column order, so that reading them
+    // only ever moves forward within a record
+    ScanPlan plan;
+    uint32_t offset = sizeof(uint32_t); // pointer to next record
+    for (int i = 0; i < numAttrs; i++) {
+        auto &attribute = schema.attributes[i];
+        if (slots[i] != -1) {
+            slots[i] = plan.columns.size();
+            plan.columns.push_back(&attribute);
+            plan.offsets.push_back(offset);
+        }
+        offset += attribute.size();
+    }
+    for (auto &predicate : bound) {
+        plan.predicates.emplace_back(slots[predicate.first], predicate.second);
+    }
+    for (int i : projection) {
+        plan.projection.push_back(slots[i]);
+    }
+    return plan;
+}
+
+static void decode(const char *image, const ScanPlan &plan, Record &row) {
+    row.clear();
+    for (size_t i = 0; i < plan.columns.size(); i++) {
+        auto &attribute = *plan.columns[i];
+        Value value(attribute);
+        if (value.type == ValueType::CHAR) {
+            value.cval[value.charCnt] = '\0';
+        }
+        std::memcpy(value.val(), image + plan.offsets[i], value.size());
+        row.emplace_back(std::move(value));
+    }
+}
+
+static bool satisfy(const ScanPlan &plan, const Record &row) {
+    for (auto &predicate : plan.predicates) {
+        if (!predicate.second->satisfiedBy(row[predicate.first])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static Record project(const ScanPlan &plan, const Record &row) {
+    Record projected;
+    projected.reserve(plan.projection.size());
+    for (int slot : plan.projection) {
+        projected.push_back(row[slot]);
+    }
+    return projected;
+}
+
+static File::tableFileHeader readHeader(const std::string &filename) {
+    BM::PtrBlock blk0 = BM::readBlock(BM::makeID(filename, 0));
+    File::tableFileHeader header;
+    std::memcpy(&header, blk0->block_data, sizeof(header));
+    if (header.filetype != static_cast<uint32_t>(File::FileType::TABLE)) {
+        throw SysError("file type not compatible");
+    }
+    if (header.version != File::TABLE_VERSION) {
+        throw SysError("file \'" + filename +
+                       "\' has an older layout; recreate the table");
+    }
+    return header;
+}
+
+// Visits the records of a data block of a heap file that have not been
+// deleted until `visit` returns false, and returns false if it did. Records
+// never straddle blocks, so each block holds records at multiples of the
+// record size.
+template <typename Visitor>
+static bool scanBlock(const std::string &filename,
+                      const File::tableFileHeader &header, uint32_t size,
+                      uint32_t blkOff, Visitor visit) {
+    BM::PtrBlock blk = BM::readBlock(BM::makeID(filename, blkOff));
+    for (uint32_t inBlkOff = 0; inBlkOff + size <= BM::BLOCK_SIZE;
+         inBlkOff += size) {
+        if (blkOff * BM::BLOCK_SIZE + inBlkOff >= header.availableOffset) {
+            return true;
+        }
+        uint32_t mark;
+        std::memcpy(&mark, blk->block_data + inBlkOff, sizeof(uint32_t));
+        if (mark & DELETED_MARK) {
+            continue;
+        }
+        if (!visit(blkOff * BM::BLOCK_SIZE + inBlkOff,
+                   blk->block_data + inBlkOff)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The block summaries of a heap table, read back from their file or
+// rebuilt from its records on first use.
+static Zone::Map &zonesOf(const Schema &schema,
+                          const File::tableFileHeader &header) {
+    auto zones = Zone::find(schema.tableName);
+    if (zones != nullptr) {
+        return *zones;
+    }
+    bool loaded = Zone::load(schema, header.availableOffset);
+    zones = Zone::find(schema.tableName);
+    if (!loaded) {
+        auto filename = File::tableFilename(schema.tableName);
+        uint32_t size = recordBinarySize(schema);
+        uint32_t lastBlk = BM::blockOffset(header.availableOffset);
+        for (uint32_t blkOff = 1; blkOff <= lastBlk; blkOff++) {
+            scanBlock(filename, header, size, blkOff,
+                      [&](uint32_t, const char *image) {
+                          zones->add(blkOff, image);
+                          return true;
+                      });
+        }
+    }
+    return *zones;
+}
+
+// Visits the offsets and images of the records of a table until `visit`
+// returns false, in insertion order, or primary key order in an lsm table.
+// A heap file is read block by block, passing over the blocks whose
+// summaries rule out the predicates; the visitor still has to check them.
+// Records of the other engines go by their ids.
+template <typename Visitor>
+static void scan(const Schema &schema, const std::vector<Predicate> &predicates,
+                 Visitor visit) {
+    auto &tableName = schema.tableName;
+    if (!hasTable(tableName)) {
+        throw SysError("missing data for table \'" + tableName + "\'");
+    }
+    if (schema.engine == TableEngine::LSM) {
+        LSM::scan(tableName, visit);
+        return;
+    }
+    if (schema.engine == TableEngine::MEMORY) {
+        Memory::scan(tableName, visit);
+        return;
+    }
+    auto filename = File::tableFilename(tableName);
+    auto header = readHeader(filename);
+    auto &zones = zonesOf(schema, header);
+    auto filter = zones.makeFilter(predicates);
+    uint32_t size = recordBinarySize(schema);
+    uint32_t lastBlk = BM::blockOffset(header.availableOffset);
+    for (uint32_t blkOff = 1; blkOff <= lastBlk; blkOff++) {
+        if (zones.mayMatch(blkOff, filter) &&
+            !scanBlock(filename, header, size, blkOff, visit)) {
+            return;
+        }
+    }
+}
+
+// Visits the records at the offsets, in their order, that have not been
+// deleted, until `visit` returns false.
+template <typename Visitor>
+static void fetch(const Schema &schema, const std::vector<uint32_t> &offsets,
+                  Visitor visit) {
+    auto &tableName = schema.tableName;
+    if (!hasTable(tableName)) {
+        throw SysError("missing data for table \'" + tableName + "\'");
+    }
+    if (schema.engine == TableEngine::LSM) {
+        std::string image;
+        for (auto id : offsets) {
+            if (LSM::get(tableName, id, image) && !visit(id, image.data())) {
+                return;
+            }
+        }
+        return;
+    }
+    if (schema.engine == TableEngine::MEMORY) {
+        for (auto id : offsets) {
+            auto image = Memory::get(tableName, id);
+            if (image != nullptr && !visit(id, image)) {
+                return;
             }
         }
+        return;
+    }
+    auto filename = File::tableFilename(tableName);
+    readHeader(filename);
+    for (auto pos : offsets) {
+        uint32_t blkOff = BM::blockOffset(pos);
+        uint32_t inBlkOff = BM::inBlockOffset(pos);
+        BM::PtrBlock blk = BM::readBlock(BM::makeID(filename, blkOff));
+        uint32_t mark;
+        std::memcpy(&mark, blk->block_data + inBlkOff, sizeof(uint32_t));
+        if (mark & DELETED_MARK) {
+            continue;
+        }
+        if (!visit(pos, blk->block_data + inBlkOff)) {
+            return;
+        }
     }
-    throw SQLError("cannot find attribute \'" + predicate.attrName +
-                   "\' in table \'" + schema->tableName + "\'");
 }
 
 bool hasTable(const std::string &tableName) {
-    return BM::fileExists(File::tableFilename(tableName));
+    return Memory::hasTable(tableName) ||
+           BM::fileExists(File::tableFilename(tableName));
 }
 
 void createTable(const std::string &tableName) {
-    if (!hasTable(tableName)) {
-        BM::createFile(File::tableFilename(tableName), File::FileType::TABLE);
-    } else {
+    if (hasTable(tableName)) {
         throw Warning("file for table \'" + tableName + "\' already exists");
     }
+    auto schema = CM::getSchema(tableName);
+    if (schema->engine == TableEngine::LSM) {
+        LSM::createTable(schema);
+    } else if (schema->engine == TableEngine::MEMORY) {
+        Memory::createTable(schema);
+    } else {
+        BM::createFile(File::tableFilename(tableName), File::FileType::TABLE);
+        Zone::reset(*schema);
+    }
 }
 
+// The catalog entry is gone by now, so the table tells the engine.
 void dropTable(const std::string &tableName) {
-    if (hasTable(tableName)) {
-        BM::deleteFile(File::tableFilename(tableName));
-    } else {
+    auto filename = File::tableFilename(tableName);
+    if (!hasTable(tableName)) {
         throw SysError("missing data for table \'" + tableName + "\'");
     }
+    if (Memory::hasTable(tableName)) {
+        Memory::dropTable(tableName);
+        return;
+    }
+    BM::PtrBlock blk0 = BM::readBlock(BM::makeID(filename, 0));
+    uint32_t filetype;
+    std::memcpy(&filetype, blk0->block_data, sizeof(uint32_t));
+    if (filetype == static_cast<uint32_t>(File::FileType::LSM)) {
+        LSM::dropTable(tableName);
+    } else {
+        BM::deleteFile(filename);
+        Zone::drop(tableName);
+    }
 }
 
 uint32_t insertRecord(const std::string &tableName, const Record &record) {
@@ -68,27 +315,6 @@ uint32_t insertRecord(const std::string &tableName, const Record &record) {
         throw SysError("missing data for table \'" + tableName + "\'");
     }
     auto schema = CM::getSchema(tableName);
-    BM::PtrBlock blk0 = BM::readBlock(BM::makeID(filename, 0));
-    blk0->resetPos();
-    File::tableFileHeader header;
-    blk0->read(reinterpret_cast<char *>(&header), sizeof(header));
-    if (header.filetype != static_cast<uint32_t>(File::FileType::TABLE)) {
-        throw SysError("file type not compatible");
-    }
-
-    uint32_t newPos = header.availableOffset;
-    uint32_t blkOff = BM::blockOffset(newPos);
-    uint32_t inBlkOff = BM::inBlockOffset(newPos);
-    BM::PtrBlock blk = BM::readBlock(BM::makeID(filename, blkOff));
-    blk->resetPos(inBlkOff);
-
-    uint32_t _offset = inBlkOff;
-    auto write = [&](const char *src, size_t size) {
-        BM::writeBlock(BM::makeID(filename, blkOff), src, _offset, size);
-        _offset += size;
-    };
-    write(reinterpret_cast<const char *>(&header.beginOffset),
-          sizeof(uint32_t));
     if (record.size() != schema->attributes.size()) {
         throw SQLError("value size mismatch");
     }
@@ -102,18 +328,55 @@ uint32_t insertRecord(const std::string &tableName, const Record &record) {
                            " is too long to fit in char(" +
                            std::to_string(schema->attributes[i].size()) + ")");
         }
+    }
+
+    uint32_t size = recordBinarySize(*schema);
+    if (size > BM::BLOCK_SIZE) {
+        throw SQLError("records of table \'" + tableName +
+                       "\' do not fit in a block");
+    }
+    if (schema->engine != TableEngine::HEAP) {
+        std::string image(size, '\0');
+        uint32_t pos = sizeof(uint32_t); // the id goes first
+        for (size_t i = 0; i < record.size(); i++) {
+            std::memcpy(&image[pos], record[i].val(),
+                        schema->attributes[i].size());
+            pos += schema->attributes[i].size();
+        }
+        if (schema->engine == TableEngine::MEMORY) {
+            return Memory::insert(tableName, image.data());
+        }
+        return LSM::insert(tableName, std::move(image));
+    }
+    auto header = readHeader(filename);
+    auto &zones = zonesOf(*schema, header);
+    uint32_t newPos = header.availableOffset;
+    uint32_t blkOff = BM::blockOffset(newPos);
+    uint32_t inBlkOff = BM::inBlockOffset(newPos);
+
+    uint32_t _offset = inBlkOff;
+    auto write = [&](const char *src, size_t size) {
+        BM::writeBlock(BM::makeID(filename, blkOff), src, _offset, size);
+        _offset += size;
+    };
+    write(reinterpret_cast<const char *>(&header.beginOffset),
+          sizeof(uint32_t));
+    for (size_t i = 0; i < record.size(); i++) {
         write(record[i].val(), schema->attributes[i].size());
     }
     header.beginOffset = newPos;
     header.numRecords++;
-    uint32_t size = recordBinarySize(*schema);
-    if (inBlkOff + size >= BM::BLOCK_SIZE) {
-        header.availableOffset = header.numBlocks++ * BM::BLOCK_SIZE;
+    header.numBlocks = blkOff + 1;
+    if (inBlkOff + 2 * size > BM::BLOCK_SIZE) {
+        header.availableOffset = (blkOff + 1) * BM::BLOCK_SIZE;
     } else {
         header.availableOffset = newPos + size;
     }
     BM::writeBlock(BM::makeID(filename, 0),
                    reinterpret_cast<const char *>(&header), 0, sizeof(header));
+    BM::PtrBlock blk = BM::readBlock(BM::makeID(filename, blkOff));
+    zones.add(blkOff, blk->block_data + inBlkOff);
+    zones.availableOffset = header.availableOffset;
     return newPos;
 }
 
@@ -122,13 +385,13 @@ int deleteAllRecords(const std::string &tableName) {
     if (!hasTable(tableName)) {
         throw SysError("missing data for table \'" + tableName + "\'");
     }
-    BM::PtrBlock blk0 = BM::readBlock(BM::makeID(filename, 0));
-    blk0->resetPos();
-    File::tableFileHeader header;
-    blk0->read(reinterpret_cast<char *>(&header), sizeof(header));
-    if (header.filetype != static_cast<uint32_t>(File::FileType::TABLE)) {
-        throw SysError("file type not compatible");
+    auto engine = CM::getSchema(tableName)->engine;
+    if (engine == TableEngine::LSM) {
+        return LSM::clear(tableName);
+    } else if (engine == TableEngine::MEMORY) {
+        return Memory::clear(tableName);
     }
+    auto header = readHeader(filename);
     int numDeleted = static_cast<int>(header.numRecords);
     header.numBlocks = 1;
     header.beginOffset = 0;
@@ -136,6 +399,7 @@ int deleteAllRecords(const std::string &tableName) {
     header.numRecords = 0;
     BM::writeBlock(BM::makeID(filename, 0),
                    reinterpret_cast<const char *>(&header), 0, sizeof(header));
+    Zone::reset(*CM::getSchema(tableName));
     return numDeleted;
 }
 
@@ -145,20 +409,24 @@ int deleteRecords(const std::string &tableName,
     if (!hasTable(tableName)) {
         throw SysError("missing data for table \'" + tableName + "\'");
     }
-    BM::PtrBlock blk0 = BM::readBlock(BM::makeID(filename, 0));
-    blk0->resetPos();
-    File::tableFileHeader header;
-    blk0->read(reinterpret_cast<char *>(&header), sizeof(header));
-    if (header.filetype != static_cast<uint32_t>(File::FileType::TABLE)) {
-        throw SysError("file type not compatible");
+    auto engine = CM::getSchema(tableName)->engine;
+    if (engine != TableEngine::HEAP) {
+        for (uint32_t id : offsets) {
+            if (engine == TableEngine::MEMORY) {
+                Memory::erase(tableName, id);
+            } else {
+                LSM::erase(tableName, id);
+            }
+        }
+        return offsets.size();
     }
+    auto header = readHeader(filename);
     for (uint32_t pos : offsets) {
         uint32_t blkOff = BM::blockOffset(pos);
         uint32_t inBlkOff = BM::inBlockOffset(pos);
         BM::PtrBlock blk = BM::readBlock(BM::makeID(filename, blkOff));
-        blk->resetPos(inBlkOff);
         uint32_t mark;
-        blk->read(reinterpret_cast<char *>(&mark), sizeof(uint32_t));
+        std::memcpy(&mark, blk->block_data + inBlkOff, sizeof(uint32_t));
         if (mark & DELETED_MARK) {
             throw SysError("record has already been deleted");
         }
@@ -173,193 +441,132 @@ int deleteRecords(const std::string &tableName,
     return offsets.size();
 }
 
-int deleteRecords(std::shared_ptr<Schema> schema,
-                  const std::vector<Predicate> &predicates) {
-    auto &tableName = schema->tableName;
-    auto filename = File::tableFilename(tableName);
-    if (!hasTable(tableName)) {
-        throw SysError("missing data for table \'" + tableName + "\'");
-    }
-    BM::PtrBlock blk0 = BM::readBlock(BM::makeID(filename, 0));
-    blk0->resetPos();
-    File::tableFileHeader header;
-    blk0->read(reinterpret_cast<char *>(&header), sizeof(header));
-    if (header.filetype != static_cast<uint32_t>(File::FileType::TABLE)) {
-        throw SysError("file type not compatible");
-    }
-    int numDeleted = 0;
-    uint32_t pos = header.beginOffset;
-    while (pos != 0) {
-        uint32_t blkOff = BM::blockOffset(pos);
-        uint32_t inBlkOff = BM::inBlockOffset(pos);
-        BM::PtrBlock blk = BM::readBlock(BM::makeID(filename, blkOff));
-        blk->resetPos(inBlkOff);
-        Record record;
-        blk->read(reinterpret_cast<char *>(&pos), sizeof(uint32_t));
-        if (pos & DELETED_MARK) {
-            pos &= DELETED_MASK;
-            continue;
-        }
-        for (auto &attribute : schema->attributes) {
-            Value value(attribute);
-            if (value.type == ValueType::CHAR) {
-                std::memset(value.val(), 0, 256);
-            }
-            blk->read(value.val(), value.size());
-            record.emplace_back(std::move(value));
-        }
-        bool chosen = true;
-        for (auto predicate : predicates) {
-            chosen &= satisfy(schema, predicate, record);
-            if (!chosen) {
-                break;
-            }
-        }
-        if (chosen) {
-            numDeleted++;
-            uint32_t marked = pos | DELETED_MARK;
-            BM::writeBlock(BM::makeID(filename, blkOff),
-                           reinterpret_cast<const char *>(&marked), inBlkOff,
-                           sizeof(uint32_t));
-        }
-    }
-    header.numRecords -= numDeleted;
-    BM::writeBlock(BM::makeID(filename, 0),
-                   reinterpret_cast<const char *>(&header), 0, sizeof(header));
-    return numDeleted;
-}
-
 std::vector<Record> selectRecords(std::shared_ptr<Schema> schema,
-                                  const std::vector<Predicate> &predicates) {
-    auto &tableName = schema->tableName;
+                                  const std::vector<Predicate> &predicates,
+                                  const std::vector<std::string> &attributes,
+                                  int limit, int offset) {
     std::vector<Record> records;
-    auto filename = File::tableFilename(tableName);
-    if (!hasTable(tableName)) {
-        throw SysError("missing data for table \'" + tableName + "\'");
-    }
-    BM::PtrBlock blk0 = BM::readBlock(BM::makeID(filename, 0));
-    blk0->resetPos();
-    File::tableFileHeader header;
-    blk0->read(reinterpret_cast<char *>(&header), sizeof(header));
-    if (header.filetype != static_cast<uint32_t>(File::FileType::TABLE)) {
-        throw SysError("file type not compatible");
+    auto plan = makePlan(*schema, predicates, attributes);
+    if (limit == 0) {
+        return records;
     }
-    uint32_t pos = header.beginOffset;
-    while (pos != 0) {
-        uint32_t blkOff = BM::blockOffset(pos);
-        uint32_t inBlkOff = BM::inBlockOffset(pos);
-        BM::PtrBlock blk = BM::readBlock(BM::makeID(filename, blkOff));
-        blk->resetPos(inBlkOff);
-        Record record;
-        blk->read(reinterpret_cast<char *>(&pos), sizeof(uint32_t));
-        if (pos & DELETED_MARK) {
-            pos &= DELETED_MASK;
-            continue;
-        }
-        for (auto &attribute : schema->attributes) {
-            Value value(attribute);
-            if (value.type == ValueType::CHAR) {
-                std::memset(value.val(), 0, 256);
-            }
-            blk->read(value.val(), value.size());
-            record.emplace_back(std::move(value));
-        }
-        bool chosen = true;
-        for (auto predicate : predicates) {
-            chosen &= satisfy(schema, predicate, record);
-            if (!chosen) {
-                break;
+    Record row;
+    scan(*schema, predicates, [&](uint32_t, const char *image) {
+        decode(image, plan, row);
+        if (satisfy(plan, row)) {
+            if (offset > 0) {
+                offset--;
+            } else {
+                records.push_back(project(plan, row));
             }
         }
-        if (chosen) {
-            records.push_back(record);
-        }
-    }
-    std::reverse(records.begin(), records.end());
+        return limit < 0 || records.size() < static_cast<size_t>(limit);
+    });
     return records;
 }
 
 std::vector<Record>
 selectRecordsWithOffsets(std::shared_ptr<Schema> schema,
                          const std::vector<Predicate> &predicates,
-                         const std::vector<uint32_t> &offsets) {
-    auto &tableName = schema->tableName;
+                         const std::vector<uint32_t> &offsets,
+                         const std::vector<std::string> &attributes, int limit,
+                         int offset) {
     std::vector<Record> records;
-    auto filename = File::tableFilename(tableName);
-    if (!hasTable(tableName)) {
-        throw SysError("missing data for table \'" + tableName + "\'");
-    }
-    BM::PtrBlock blk0 = BM::readBlock(BM::makeID(filename, 0));
-    blk0->resetPos();
-    File::tableFileHeader header;
-    blk0->read(reinterpret_cast<char *>(&header), sizeof(header));
-    if (header.filetype != static_cast<uint32_t>(File::FileType::TABLE)) {
-        throw SysError("file type not compatible");
+    auto plan = makePlan(*schema, predicates, attributes);
+    if (limit == 0) {
+        return records;
     }
-    for (auto pos : offsets) {
-        uint32_t blkOff = BM::blockOffset(pos);
-        uint32_t inBlkOff = BM::inBlockOffset(pos);
-        BM::PtrBlock blk = BM::readBlock(BM::makeID(filename, blkOff));
-        blk->resetPos(inBlkOff);
-        Record record;
-        blk->read(reinterpret_cast<char *>(&pos), sizeof(uint32_t));
-        if (pos & DELETED_MARK) {
-            pos &= DELETED_MASK;
-            continue;
-        }
-        for (auto &attribute : schema->attributes) {
-            Value value(attribute);
-            if (value.type == ValueType::CHAR) {
-                std::memset(value.val(), 0, 256);
+    Record row;
+    fetch(*schema, offsets, [&](uint32_t, const char *image) {
+        decode(image, plan, row);
+        if (satisfy(plan, row)) {
+            if (offset > 0) {
+                offset--;
+            } else {
+                records.push_back(project(plan, row));
             }
-            blk->read(value.val(), value.size());
-            record.emplace_back(std::move(value));
         }
-        bool chosen = true;
-        for (auto predicate : predicates) {
-            chosen &= satisfy(schema, predicate, record);
-            if (!chosen) {
-                break;
-            }
-        }
-        if (chosen) {
-            records.push_back(record);
-        }
-    }
+        return limit < 0 || records.size() < static_cast<size_t>(limit);
+    });
     return records;
 }
 
-std::vector<Record> project(const std::vector<Record> &records,
-                            std::shared_ptr<Schema> schema,
-                            const std::vector<std::string> &attributes) {
-    if (attributes.empty()) {
-        return records;
+void scanRecords(
+    std::shared_ptr<Schema> schema, const std::vector<std::string> &attributes,
+    const std::function<void(uint32_t, const Record &)> &visit) {
+    auto plan = makePlan(*schema, {}, attributes);
+    Record row;
+    scan(*schema, {}, [&](uint32_t pos, const char *image) {
+        decode(image, plan, row);
+        visit(pos, project(plan, row));
+        return true;
+    });
+}
+
+void fetchRecords(
+    std::shared_ptr<Schema> schema, const std::vector<uint32_t> &offsets,
+    const std::vector<std::string> &attributes,
+    const std::function<void(uint32_t, const Record &)> &visit) {
+    auto plan = makePlan(*schema, {}, attributes);
+    Record row;
+    fetch(*schema, offsets, [&](uint32_t pos, const char *image) {
+        decode(image, plan, row);
+        visit(pos, project(plan, row));
+        return true;
+    });
+}
+
+std::vector<uint32_t> selectOffsets(std::shared_ptr<Schema> schema,
+                                    const std::vector<Predicate> &predicates) {
+    std::vector<uint32_t> selected;
+    std::vector<std::string> attributes;
+    for (auto &predicate : predicates) {
+        attributes.push_back(predicate.attrName);
     }
-    std::vector<int> permutation;
-    for (auto &attrName : attributes) {
-        bool found = false;
-        for (int i = 0; !found && i < schema->attributes.size(); i++) {
-            if (attrName == schema->attributes[i].name) {
-                permutation.push_back(i);
-                found = true;
-            }
-        }
-        if (!found) {
-            throw SQLError("cannot find attribute \'" + attrName +
-                           "\' in table \'" + schema->tableName + "\'");
+    auto plan = makePlan(*schema, predicates, attributes);
+    Record row;
+    scan(*schema, predicates, [&](uint32_t pos, const char *image) {
+        decode(image, plan, row);
+        if (satisfy(plan, row)) {
+            selected.push_back(pos);
         }
+        return true;
+    });
+    return selected;
+}
+
+std::vector<uint32_t> selectOffsets(std::shared_ptr<Schema> schema,
+                                    const std::vector<Predicate> &predicates,
+                                    const std::vector<uint32_t> &offsets) {
+    std::vector<uint32_t> selected;
+    std::vector<std::string> attributes;
+    for (auto &predicate : predicates) {
+        attributes.push_back(predicate.attrName);
     }
-    std::vector<Record> results;
-    for (auto &record : records) {
-        Record projected;
-        for (int pos : permutation) {
-            projected.emplace_back(record[pos]);
+    auto plan = makePlan(*schema, predicates, attributes);
+    Record row;
+    fetch(*schema, offsets, [&](uint32_t pos, const char *image) {
+        decode(image, plan, row);
+        if (satisfy(plan, row)) {
+            selected.push_back(pos);
         }
-        results.emplace_back(projected);
+        return true;
+    });
+    return selected;
+}
+
+bool findPrimaryKey(const std::string &tableName, const Value &value,
+                    uint32_t &offset) {
+    if (CM::getSchema(tableName)->engine == TableEngine::LSM) {
+        return LSM::find(tableName, value, offset);
     }
-    return results;
+    return Memory::find(tableName, value, offset);
 }
 
-void exit() {}
+void exit() {
+    LSM::exit();
+    Memory::exit();
+    Zone::exit();
+}
 
-} // namespace RM
\ No newline at end of file
+} // namespace RM
@@ -0,0 +1,223 @@
+#include <BufferManager/Block.h>
+#include <Error.h>
+#include <FileSpec.h>
+#include <IndexManager/Key.h>
+#include <RecordManager/Zone.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <unordered_map>
+
+namespace RM {
+
+namespace Zone {
+
+static std::unordered_map<std::string, std::unique_ptr<Map>> maps;
+
+// The leading bytes of the key encoding of a value. Cutting it keeps the
+// order of the values, though no longer strictly, and a CHAR encoding ends
+// with a NUL already, so that padding with more keeps it as well.
+static void encodeBound(char *dest, const Value &value) {
+    std::string encoded;
+    IM::encodeValue(encoded, value);
+    encoded.resize(PREFIX, '\0');
+    std::memcpy(dest, encoded.data(), PREFIX);
+}
+
+Map::Map(const Schema &schema) : availableOffset(BM::BLOCK_SIZE) {
+    uint32_t offset = sizeof(uint32_t); // pointer to next record
+    for (auto &attribute : schema.attributes) {
+        columns.push_back(attribute);
+        offsets.push_back(offset);
+        offset += attribute.size();
+    }
+}
+
+void Map::add(uint32_t blkOff, const char *image) {
+    size_t width = columns.size() * PREFIX;
+    if (counts.size() < blkOff) {
+        counts.resize(blkOff, 0);
+        lows.resize(blkOff * width, '\0');
+        highs.resize(blkOff * width, '\0');
+    }
+    uint32_t i = blkOff - 1;
+    bool first = counts[i]++ == 0;
+    char bound[PREFIX];
+    for (size_t j = 0; j < columns.size(); j++) {
+        Value value(columns[j]);
+        if (value.type == ValueType::CHAR) {
+            value.cval[value.charCnt] = '\0';
+        }
+        std::memcpy(value.val(), image + offsets[j], value.size());
+        encodeBound(bound, value);
+        char *low = &lows[i * width + j * PREFIX];
+        char *high = &highs[i * width + j * PREFIX];
+        if (first || std::memcmp(bound, low, PREFIX) < 0) {
+            std::memcpy(low, bound, PREFIX);
+        }
+        if (first || std::memcmp(bound, high, PREFIX) > 0) {
+            std::memcpy(high, bound, PREFIX);
+        }
+    }
+}
+
+void Map::clear() {
+    availableOffset = BM::BLOCK_SIZE;
+    counts.clear();
+    lows.clear();
+    highs.clear();
+}
+
+Filter Map::makeFilter(const std::vector<Predicate> &predicates) const {
+    Filter filter;
+    for (auto &predicate : predicates) {
+        // records that differ from a value may be anywhere
+        if (predicate.op == OpType::NE) {
+            continue;
+        }
+        for (size_t j = 0; j < columns.size(); j++) {
+            // a value of another type is for the scan to complain about
+            if (columns[j].name != predicate.attrName ||
+                columns[j].type != predicate.val.type) {
+                continue;
+            }
+            std::string bound(PREFIX, '\0');
+            encodeBound(&bound[0], predicate.val);
+            filter.emplace_back(j, predicate.op, std::move(bound));
+            break;
+        }
+    }
+    return filter;
+}
+
+// A value v in a block has low <= p(v) <= high for the bound p(v) of it,
+// and v < c implies p(v) <= p(c), so the comparisons below are not strict.
+bool Map::mayMatch(uint32_t blkOff, const Filter &filter) const {
+    if (blkOff > counts.size()) {
+        return true;
+    }
+    uint32_t i = blkOff - 1;
+    if (counts[i] == 0) {
+        return false;
+    }
+    size_t width = columns.size() * PREFIX;
+    for (auto &condition : filter) {
+        size_t at = i * width + std::get<0>(condition) * PREFIX;
+        const char *bound = std::get<2>(condition).data();
+        bool belowHigh = std::memcmp(bound, &highs[at], PREFIX) <= 0;
+        bool aboveLow = std::memcmp(bound, &lows[at], PREFIX) >= 0;
+        switch (std::get<1>(condition)) {
+        case OpType::EQ:
+            if (!belowHigh || !aboveLow) {
+                return false;
+            }
+            break;
+        case OpType::LT:
+        case OpType::LEQ:
+            if (!aboveLow) {
+                return false;
+            }
+            break;
+        case OpType::GT:
+        case OpType::GEQ:
+            if (!belowHigh) {
+                return false;
+            }
+            break;
+        case OpType::NE:
+            break;
+        }
+    }
+    return true;
+}
+
+void Map::write(std::ostream &os) const {
+    File::zoneFileHeader header;
+    header.filetype = static_cast<uint32_t>(File::FileType::ZONE);
+    header.availableOffset = availableOffset;
+    header.numBlocks = static_cast<uint32_t>(counts.size());
+    header.numColumns = static_cast<uint32_t>(columns.size());
+    os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    size_t width = columns.size() * PREFIX;
+    for (size_t i = 0; i < counts.size(); i++) {
+        os.write(reinterpret_cast<const char *>(&counts[i]), sizeof(uint32_t));
+        os.write(&lows[i * width], width);
+        os.write(&highs[i * width], width);
+    }
+}
+
+bool Map::read(std::istream &is) {
+    File::zoneFileHeader header;
+    is.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!is || header.filetype != static_cast<uint32_t>(File::FileType::ZONE) ||
+        header.numColumns != columns.size()) {
+        return false;
+    }
+    size_t width = columns.size() * PREFIX;
+    counts.resize(header.numBlocks);
+    lows.resize(header.numBlocks * width);
+    highs.resize(header.numBlocks * width);
+    for (size_t i = 0; i < counts.size() && is; i++) {
+        is.read(reinterpret_cast<char *>(&counts[i]), sizeof(uint32_t));
+        is.read(&lows[i * width], width);
+        is.read(&highs[i * width], width);
+    }
+    availableOffset = header.availableOffset;
+    return static_cast<bool>(is);
+}
+
+bool load(const Schema &schema, uint32_t availableOffset) {
+    auto filename = File::zoneFilename(schema.tableName);
+    std::unique_ptr<Map> map(new Map(schema));
+    bool loaded = false;
+    {
+        std::ifstream ifs(filename, std::ios::in | std::ios::binary);
+        loaded = !ifs.fail() && map->read(ifs) &&
+                 map->availableOffset == availableOffset;
+    }
+    std::remove(filename.c_str());
+    if (!loaded) {
+        map->clear();
+        map->availableOffset = availableOffset;
+    }
+    maps[schema.tableName] = std::move(map);
+    return loaded;
+}
+
+void reset(const Schema &schema) {
+    std::remove(File::zoneFilename(schema.tableName).c_str());
+    maps[schema.tableName].reset(new Map(schema));
+}
+
+Map *find(const std::string &tableName) {
+    auto iter = maps.find(tableName);
+    return iter != maps.end() ? iter->second.get() : nullptr;
+}
+
+void drop(const std::string &tableName) {
+    maps.erase(tableName);
+    std::remove(File::zoneFilename(tableName).c_str());
+}
+
+void exit() {
+    for (auto &entry : maps) {
+        auto filename = File::zoneFilename(entry.first);
+        auto tmpFilename = filename + ".tmp";
+        std::ofstream ofs(tmpFilename, std::ios::out | std::ios::binary);
+        if (ofs.fail()) {
+            throw SysError("cannot create file \'" + tmpFilename + "\'");
+        }
+        entry.second->write(ofs);
+        ofs.close();
+        if (ofs.fail() ||
+            std::rename(tmpFilename.c_str(), filename.c_str())) {
+            throw SysError("cannot write file \'" + filename + "\'");
+        }
+    }
+    maps.clear();
+}
+
+} // namespace Zone
+
+} // namespace RM